@@ -119,6 +119,7 @@
 #define MAX_GPU_INSTANCE		64
 
 #define GFX_SLICE_PERIOD		msecs_to_jiffies(250)
+#define GFX_SLICE_POLL_PERIOD		msecs_to_jiffies(10)
 
 struct amdgpu_gpu_instance {
 	struct amdgpu_device		*adev;
@@ -191,6 +192,13 @@ extern int amdgpu_exp_hw_support;
 extern int amdgpu_dc;
 extern int amdgpu_sched_jobs;
 extern int amdgpu_sched_hw_submission;
+extern int amdgpu_hang_watchdog;
+extern uint amdgpu_hang_stall_ms;
+extern uint amdgpu_fence_poll_us;
+extern uint amdgpu_fence_deferred_signal;
+extern int amdgpu_gtt_numa;
+extern uint amdgpu_ras_cache_ms;
+extern int amdgpu_huge_mmap;
 extern uint amdgpu_pcie_gen_cap;
 extern uint amdgpu_pcie_lane_cap;
 extern u64 amdgpu_cg_mask;
@@ -236,12 +244,14 @@ extern bool enforce_isolation;
 extern int sched_policy;
 extern bool debug_evictions;
 extern bool no_system_mem_limit;
+extern bool userptr_range_inval;
 extern int halt_if_hws_hang;
 extern uint amdgpu_svm_default_granularity;
 #else
 static const int __maybe_unused sched_policy = KFD_SCHED_POLICY_HWS;
 static const bool __maybe_unused debug_evictions; /* = false */
 static const bool __maybe_unused no_system_mem_limit;
+static const bool __maybe_unused userptr_range_inval;
 static const int __maybe_unused halt_if_hws_hang;
 #endif
 #ifdef CONFIG_HSA_AMD_P2P
@@ -934,6 +944,14 @@ struct amdgpu_device {
 	atomic64_t			num_bytes_moved;
 	atomic64_t			num_evictions;
 	atomic64_t			num_vram_cpu_page_faults;
+	/* bytes moved to make VRAM CPU visible on page faults */
+	atomic64_t			num_vram_cpu_fault_bytes;
+	/* faults on partially visible BOs mapped without a move */
+	atomic64_t			num_vram_cpu_window_faults;
+	/* CPU faults mapped with PMD and PUD entries, and falling back */
+	atomic64_t			num_huge_faults_pmd;
+	atomic64_t			num_huge_faults_pud;
+	atomic64_t			num_huge_faults_fallback;
 	atomic_t			gpu_reset_counter;
 	atomic_t			vram_lost_counter;
 
@@ -967,6 +985,7 @@ struct amdgpu_device {
 	struct dma_fence __rcu		*gang_submit;
 	bool				ib_pool_ready;
 	struct amdgpu_sa_manager	ib_pools[AMDGPU_IB_POOL_MAX];
+	struct amdgpu_ib_pool		*ring_ib_pools[AMDGPU_MAX_RINGS];
 	struct amdgpu_sched		gpu_sched[AMDGPU_HW_IP_NUM][AMDGPU_RING_PRIO_MAX];
 
 	/* interrupts */
@@ -1222,6 +1241,8 @@ uint32_t amdgpu_device_wait_on_rreg(struct amdgpu_device *adev,
 			    uint32_t expected_value, uint32_t mask);
 uint32_t amdgpu_device_rreg(struct amdgpu_device *adev,
 			    uint32_t reg, uint32_t acc_flags);
+void amdgpu_device_rreg_batch(struct amdgpu_device *adev, const uint32_t *regs,
+			      uint32_t *vals, uint32_t count);
 u32 amdgpu_device_indirect_rreg_ext(struct amdgpu_device *adev,
 				    u64 reg_addr);
 uint32_t amdgpu_device_xcc_rreg(struct amdgpu_device *adev,
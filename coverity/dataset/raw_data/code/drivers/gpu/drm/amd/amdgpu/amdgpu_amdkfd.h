@@ -82,6 +82,10 @@ struct kgd_mem {
 
 	uint32_t invalid;
 	struct amdkfd_process_info *process_info;
+	/* bo->move_seq when the mappings were last restored, protected by
+	 * amdkfd_process_info.lock
+	 */
+	u64 restored_move_seq;
 
 	struct amdgpu_sync sync;
 
@@ -111,6 +115,16 @@ struct amdgpu_kfd_dev {
 
 	/* Client for KFD BO GEM handle allocations */
 	struct drm_client_dev client;
+
+	/* Process BO restore statistics */
+	atomic64_t restore_count;
+	atomic64_t restore_time_ns;
+	atomic64_t restore_bos;
+	atomic64_t restore_bytes;
+
+	/* Userptr invalidation statistics */
+	atomic64_t userptr_quiesce;
+	atomic64_t userptr_range_inval;
 };
 
 enum kgd_engine_type {
@@ -145,6 +159,10 @@ struct amdkfd_process_info {
 	/* MMU-notifier related fields */
 	struct mutex notifier_lock;
 	uint32_t evicted_bos;
+	/* queues were stopped for the current userptr eviction */
+	bool userptr_queues_quiesced;
+	/* unmap invalidated userptr BOs instead of stopping the queues */
+	bool userptr_range_inval;
 	struct delayed_work restore_userptr_work;
 	struct pid *pid;
 	bool block_mmu_notifications;
@@ -195,6 +213,7 @@ struct amdgpu_amdkfd_fence *to_amdgpu_amdkfd_fence(struct dma_fence *f);
 int amdgpu_amdkfd_remove_fence_on_pt_pd_bos(struct amdgpu_bo *bo);
 int amdgpu_amdkfd_evict_userptr(struct mmu_interval_notifier *mni,
 				unsigned long cur_seq, struct kgd_mem *mem);
+bool amdgpu_amdkfd_userptr_fault(struct amdgpu_vm *vm, uint64_t addr);
 int amdgpu_amdkfd_bo_validate_and_fence(struct amdgpu_bo *bo,
 					uint32_t domain,
 					struct dma_fence *fence);
@@ -223,6 +242,13 @@ int amdgpu_amdkfd_evict_userptr(struct mmu_interval_notifier *mni,
 {
 	return 0;
 }
+
+static inline
+bool amdgpu_amdkfd_userptr_fault(struct amdgpu_vm *vm, uint64_t addr)
+{
+	return false;
+}
+
 static inline
 int amdgpu_amdkfd_bo_validate_and_fence(struct amdgpu_bo *bo,
 					uint32_t domain,
@@ -376,12 +402,18 @@ void amdgpu_amdkfd_gpuvm_destroy_cb(struct amdgpu_device *adev,
  */
 void amdgpu_amdkfd_release_notify(struct amdgpu_bo *bo);
 void amdgpu_amdkfd_reserve_system_mem(uint64_t size);
+void amdgpu_amdkfd_debugfs_init(struct amdgpu_device *adev);
 #else
 static inline
 void amdgpu_amdkfd_gpuvm_init_mem_limits(void)
 {
 }
 
+static inline
+void amdgpu_amdkfd_debugfs_init(struct amdgpu_device *adev)
+{
+}
+
 static inline
 void amdgpu_amdkfd_gpuvm_destroy_cb(struct amdgpu_device *adev,
 					struct amdgpu_vm *vm)
@@ -1440,6 +1440,14 @@ static int init_kfd_vm(struct amdgpu_vm *vm, void **process_info,
 			&(vm->process_info->vm_list_head));
 	vm->process_info->n_vms++;
 
+	/* Unmapping userptrs without stopping the queues relies on the GPU
+	 * retrying faults, which all GPUs of the process must support.
+	 */
+	WRITE_ONCE(vm->process_info->userptr_range_inval,
+		   (vm->process_info->n_vms == 1 ? userptr_range_inval :
+		    vm->process_info->userptr_range_inval) &&
+		   !amdgpu_ttm_adev(vm->root.bo->tbo.bdev)->gmc.noretry);
+
 	*ef = dma_fence_get(&vm->process_info->eviction_fence->base);
 	mutex_unlock(&vm->process_info->lock);
 
@@ -2494,6 +2502,111 @@ out:
 	return ret;
 }
 
+/* Retry faults on unmapped userptrs need XNACK, which is set per process */
+static bool kfd_mem_userptr_xnack_enabled(struct mm_struct *mm)
+{
+	struct kfd_process *p;
+	bool enabled;
+
+	p = kfd_lookup_process_by_mm(mm);
+	if (!p)
+		return false;
+
+	enabled = p->xnack_enabled;
+	kfd_unref_process(p);
+
+	return enabled;
+}
+
+/* Whether the user address range of a userptr BO is still fully mapped
+ *
+ * Faults on BOs whose range was munmapped or lost the access the BO needs
+ * can never be resolved, getting the user pages fails with -EFAULT. The
+ * caller holds a reservation and mmap_lock nests outside of those, so only
+ * trylock it. Assume the range is mapped if that fails, the fault comes back
+ * and is checked again.
+ */
+static bool kfd_mem_userptr_mapped(struct amdgpu_bo *bo, struct mm_struct *mm)
+{
+	struct vm_area_struct *vma;
+	unsigned long vm_flags;
+	uint64_t start, end;
+	bool mapped = false;
+
+	if (amdgpu_ttm_tt_get_userptr(&bo->tbo, &start))
+		return false;
+	end = start + amdgpu_bo_size(bo);
+	vm_flags = VM_READ;
+	if (!amdgpu_ttm_tt_is_readonly(bo->tbo.ttm))
+		vm_flags |= VM_WRITE;
+
+	if (!mmget_not_zero(mm))
+		return false;
+
+	if (!mmap_read_trylock(mm)) {
+		mmput(mm);
+		return true;
+	}
+
+	do {
+		vma = vma_lookup(mm, start);
+		if (!vma || (vma->vm_flags & (VM_IO | VM_PFNMAP)) ||
+		    (vma->vm_flags & vm_flags) != vm_flags)
+			break;
+		start = vma->vm_end;
+		mapped = start >= end;
+	} while (!mapped);
+
+	mmap_read_unlock(mm);
+	mmput(mm);
+
+	return mapped;
+}
+
+/* Unmap a userptr BO from all GPUs without stopping the queues
+ *
+ * GPU accesses to the BO retry fault until the restore worker has mapped
+ * the new pages. The whole BO is unmapped, because restoring it DMA unmaps
+ * all of its pages. This covers the BO itself as well as the SG BOs used to
+ * DMA map it on other GPUs. Returns an error if the attachments can't be
+ * locked or the unmap fails, the caller must stop the queues then.
+ */
+static int kfd_mem_unmap_userptr(struct kgd_mem *mem)
+{
+	uint64_t size = amdgpu_bo_size(mem->bo) / AMDGPU_GPU_PAGE_SIZE;
+	struct kfd_mem_attachment *entry;
+	int ret = 0;
+
+	/* Attachments are only stable under mem->lock */
+	if (!mutex_trylock(&mem->lock))
+		return -EBUSY;
+
+	list_for_each_entry(entry, &mem->attachments, list) {
+		struct amdgpu_vm *vm = entry->bo_va->base.vm;
+		uint64_t start = entry->va / AMDGPU_GPU_PAGE_SIZE;
+		struct dma_fence *fence = NULL;
+
+		if (!entry->is_mapped)
+			continue;
+
+		ret = amdgpu_vm_update_range(entry->adev, vm, false, true, true,
+					     false, NULL, start, start + size - 1,
+					     0, 0, 0, NULL, NULL, &fence);
+		if (!ret && fence)
+			ret = dma_fence_wait(fence, false);
+		dma_fence_put(fence);
+		if (ret)
+			break;
+
+		amdgpu_gmc_flush_gpu_tlb_pasid(entry->adev, vm->pasid, 2,
+					       true, 0);
+	}
+
+	mutex_unlock(&mem->lock);
+
+	return ret;
+}
+
 /* Evict a userptr BO by stopping the queues if necessary
  *
  * Runs in MMU notifier, may be in RECLAIM_FS context. This means it
@@ -2502,7 +2615,9 @@ out:
  *
  * It doesn't do anything to the BO itself. The real work happens in
  * restore, where we get updated page addresses. This function only
- * ensures that GPU access to the BO is stopped.
+ * ensures that GPU access to the BO is stopped, either by unmapping the
+ * BO when the GPUs can retry the resulting faults, or by stopping the
+ * queues.
  */
 int amdgpu_amdkfd_evict_userptr(struct mmu_interval_notifier *mni,
 				unsigned long cur_seq, struct kgd_mem *mem)
@@ -2520,21 +2635,86 @@ int amdgpu_amdkfd_evict_userptr(struct mmu_interval_notifier *mni,
 	mmu_interval_set_seq(mni, cur_seq);
 
 	mem->invalid++;
-	if (++process_info->evicted_bos == 1) {
-		/* First eviction, stop the queues */
-		r = kgd2kfd_quiesce_mm(mni->mm,
-				       KFD_QUEUE_EVICTION_TRIGGER_USERPTR);
-		if (r)
-			pr_err("Failed to quiesce KFD\n");
+	if (!process_info->userptr_queues_quiesced) {
+		struct amdgpu_device *adev = amdgpu_ttm_adev(mem->bo->tbo.bdev);
+
+		if (READ_ONCE(process_info->userptr_range_inval) &&
+		    kfd_mem_userptr_xnack_enabled(mni->mm) &&
+		    !kfd_mem_unmap_userptr(mem)) {
+			atomic64_inc(&adev->kfd.userptr_range_inval);
+		} else {
+			/* Stop the queues until the BOs are restored */
+			r = kgd2kfd_quiesce_mm(mni->mm,
+					       KFD_QUEUE_EVICTION_TRIGGER_USERPTR);
+			if (r)
+				pr_err("Failed to quiesce KFD\n");
+			process_info->userptr_queues_quiesced = true;
+			atomic64_inc(&adev->kfd.userptr_quiesce);
+		}
+	}
+	if (++process_info->evicted_bos == 1)
+		/* First eviction, schedule the restore */
 		queue_delayed_work(system_freezable_wq,
 			&process_info->restore_userptr_work,
 			msecs_to_jiffies(AMDGPU_USERPTR_RESTORE_DELAY_MS));
-	}
 	mutex_unlock(&process_info->notifier_lock);
 
 	return r;
 }
 
+/**
+ * amdgpu_amdkfd_userptr_fault - Handle a retry fault on an unmapped userptr
+ *
+ * @vm: the faulting compute VM, its root PD must be reserved
+ * @addr: faulting address in GPU pages
+ *
+ * Userptr BOs unmapped by range invalidation are left to retry fault until
+ * the restore worker maps them again. Expedite the restore and tell the
+ * caller to keep the fault retrying. The fault may hit the userptr BO itself
+ * or the SG BO which DMA maps it on another GPU. Processes without XNACK
+ * can't retry, their faults stay fatal. So do faults the restore can't
+ * resolve, because the user range was munmapped.
+ *
+ * Returns true if the fault is on such a userptr BO and the restore can
+ * succeed.
+ */
+bool amdgpu_amdkfd_userptr_fault(struct amdgpu_vm *vm, uint64_t addr)
+{
+	struct amdkfd_process_info *process_info = vm->process_info;
+	struct amdgpu_bo_va_mapping *mapping;
+	struct mm_struct *mm;
+	struct amdgpu_bo *bo;
+	struct kgd_mem *mem;
+
+	if (!process_info || !READ_ONCE(process_info->userptr_range_inval))
+		return false;
+
+	mapping = amdgpu_vm_bo_lookup_mapping(vm, addr);
+	if (!mapping || !mapping->bo_va || !mapping->bo_va->base.bo)
+		return false;
+
+	bo = mapping->bo_va->base.bo;
+	if (bo->tbo.type == ttm_bo_type_sg && bo->parent)
+		bo = bo->parent;
+
+	mem = bo->kfd_bo;
+	if (!mem || mem->bo != bo)
+		return false;
+
+	mm = amdgpu_ttm_tt_get_usermm(bo->tbo.ttm);
+	if (!mm || !kfd_mem_userptr_xnack_enabled(mm) ||
+	    !kfd_mem_userptr_mapped(bo, mm))
+		return false;
+
+	mutex_lock(&process_info->notifier_lock);
+	if (mem->invalid)
+		mod_delayed_work(system_freezable_wq,
+				 &process_info->restore_userptr_work, 0);
+	mutex_unlock(&process_info->notifier_lock);
+
+	return true;
+}
+
 /* Update invalid userptr BOs
  *
  * Moves invalidated (evicted) userptr BOs from userptr_valid_list to
@@ -2635,6 +2815,59 @@ unlock_out:
 	return ret;
 }
 
+/* Map restored userptr BOs while holding the notifier lock
+ *
+ * Without stopping the queues on eviction, the GPU may use the PTEs as soon
+ * as they are written. Only write them if the user pages weren't invalidated
+ * again since they were fetched, and wait for the update before dropping the
+ * lock so it can't land after the unmap of a later invalidation. BOs which
+ * were invalidated again stay unmapped until the next restore attempt.
+ */
+static int update_user_pages_pte_locked(struct amdkfd_process_info *process_info)
+{
+	struct kfd_mem_attachment *attachment;
+	unsigned int noreclaim_flag;
+	struct amdgpu_sync sync;
+	struct kgd_mem *mem;
+	int ret = 0;
+
+	amdgpu_sync_create(&sync);
+
+	mutex_lock(&process_info->notifier_lock);
+	/* The notifier takes this lock in reclaim */
+	noreclaim_flag = memalloc_noreclaim_save();
+
+	list_for_each_entry(mem, &process_info->userptr_inval_list,
+			    validate_list) {
+		if (mem->range &&
+		    mmu_interval_read_retry(mem->range->notifier,
+					    mem->range->notifier_seq))
+			continue;
+
+		list_for_each_entry(attachment, &mem->attachments, list) {
+			if (!attachment->is_mapped)
+				continue;
+
+			kfd_mem_dmaunmap_attachment(mem, attachment);
+			ret = update_gpuvm_pte(mem, attachment, &sync);
+			if (ret) {
+				pr_err("%s: update PTE failed\n", __func__);
+				/* make sure this gets validated again */
+				mem->invalid++;
+				goto out;
+			}
+		}
+	}
+
+out:
+	amdgpu_sync_wait(&sync, false);
+	memalloc_noreclaim_restore(noreclaim_flag);
+	mutex_unlock(&process_info->notifier_lock);
+	amdgpu_sync_free(&sync);
+
+	return ret;
+}
+
 /* Validate invalid userptr BOs
  *
  * Validates BOs on the userptr_inval_list. Also updates GPUVM page tables
@@ -2700,6 +2933,10 @@ static int validate_invalid_user_pages(struct amdkfd_process_info *process_info)
 			}
 		}
 
+		/* The queues may be running, map under the notifier lock */
+		if (READ_ONCE(process_info->userptr_range_inval))
+			continue;
+
 		/* Update mapping. If the BO was not validated
 		 * (because we couldn't get user pages), this will
 		 * clear the page table entries, which will result in
@@ -2723,6 +2960,12 @@ static int validate_invalid_user_pages(struct amdkfd_process_info *process_info)
 		}
 	}
 
+	if (READ_ONCE(process_info->userptr_range_inval)) {
+		ret = update_user_pages_pte_locked(process_info);
+		if (ret)
+			goto unreserve_out;
+	}
+
 	/* Update page directories */
 	ret = process_update_pds(process_info, &sync);
 
@@ -2836,11 +3079,14 @@ static void amdgpu_amdkfd_restore_userptr_worker(struct work_struct *work)
 
 	process_info->evicted_bos = evicted_bos = 0;
 
-	if (kgd2kfd_resume_mm(mm)) {
-		pr_err("%s: Failed to resume KFD\n", __func__);
-		/* No recovery from this failure. Probably the CP is
-		 * hanging. No point trying again.
-		 */
+	if (process_info->userptr_queues_quiesced) {
+		process_info->userptr_queues_quiesced = false;
+		if (kgd2kfd_resume_mm(mm)) {
+			pr_err("%s: Failed to resume KFD\n", __func__);
+			/* No recovery from this failure. Probably the CP is
+			 * hanging. No point trying again.
+			 */
+		}
 	}
 
 unlock_notifier_out:
@@ -2877,6 +3123,23 @@ static void replace_eviction_fence(struct dma_fence __rcu **ef,
 	dma_fence_put(old_ef);
 }
 
+/* Check if the BO of @mem moved since its mappings were last restored */
+static bool kfd_mem_needs_restore(struct kgd_mem *mem)
+{
+	return mem->restored_move_seq != mem->bo->move_seq;
+}
+
+/* Remember that the mappings of @mem are up to date, unless the BO is not in
+ * its preferred domain and the next restore should try to move it back.
+ */
+static void kfd_mem_restored(struct kgd_mem *mem)
+{
+	struct ttm_resource *res = mem->bo->tbo.resource;
+
+	if (res && amdgpu_mem_type_to_domain(res->mem_type) & mem->domain)
+		mem->restored_move_seq = mem->bo->move_seq;
+}
+
 /** amdgpu_amdkfd_gpuvm_restore_process_bos - Restore all BOs for the given
  *   KFD process identified by process_info
  *
@@ -2891,9 +3154,13 @@ static void replace_eviction_fence(struct dma_fence __rcu **ef,
  *     BOs that need to be reserved.
  * 4.  Reserve all the BOs
  * 5.  Validate of PD and PT BOs.
- * 6.  Validate all KFD BOs using kfd_bo_list and Map them and add new fence
- * 7.  Add fence to all PD and PT BOs.
+ * 6.  Validate the KFD BOs which moved since the last restore and Map them
+ * 7.  Add fence to all BOs, PD and PT BOs.
  * 8.  Unreserve all BOs
+ *
+ * All BOs are still reserved because the new eviction fence must be added to
+ * every one of them, but only moved BOs are validated and get their PTEs
+ * updated, unless a VM lost its page tables.
  */
 int amdgpu_amdkfd_gpuvm_restore_process_bos(void *info, struct dma_fence __rcu **ef)
 {
@@ -2904,10 +3171,13 @@ int amdgpu_amdkfd_gpuvm_restore_process_bos(void *info, struct dma_fence __rcu *
 	struct amdgpu_sync sync_obj;
 	unsigned long failed_size = 0;
 	unsigned long total_size = 0;
+	bool full_restore = false;
 	struct drm_exec exec;
+	ktime_t start;
 	int ret;
 
 	INIT_LIST_HEAD(&duplicate_save);
+	start = ktime_get();
 
 	mutex_lock(&process_info->lock);
 
@@ -2942,16 +3212,32 @@ int amdgpu_amdkfd_gpuvm_restore_process_bos(void *info, struct dma_fence __rcu *
 
 	amdgpu_sync_create(&sync_obj);
 
+	/* A VM which lost its page tables needs all mappings restored */
+	list_for_each_entry(peer_vm, &process_info->vm_list_head,
+			    vm_list_node) {
+		struct amdgpu_device *adev = amdgpu_ttm_adev(
+			peer_vm->root.bo->tbo.bdev);
+
+		if (peer_vm->generation != amdgpu_vm_generation(adev, peer_vm))
+			full_restore = true;
+	}
+
 	/* Validate BOs managed by KFD */
 	list_for_each_entry(mem, &process_info->kfd_bo_list,
 			    validate_list) {
 
 		struct amdgpu_bo *bo = mem->bo;
+		struct amdgpu_device *adev = amdgpu_ttm_adev(bo->tbo.bdev);
 		uint32_t domain = mem->domain;
 		struct dma_resv_iter cursor;
 		struct dma_fence *fence;
+		u64 move_seq;
+
+		if (!full_restore && !kfd_mem_needs_restore(mem))
+			continue;
 
 		total_size += amdgpu_bo_size(bo);
+		move_seq = bo->move_seq;
 
 		ret = amdgpu_amdkfd_bo_validate(bo, domain, false);
 		if (ret) {
@@ -2964,6 +3250,12 @@ int amdgpu_amdkfd_gpuvm_restore_process_bos(void *info, struct dma_fence __rcu *
 				goto validate_map_fail;
 			}
 		}
+
+		atomic64_inc(&adev->kfd.restore_bos);
+		if (bo->move_seq != move_seq)
+			atomic64_add(amdgpu_bo_size(bo),
+				     &adev->kfd.restore_bytes);
+
 		dma_resv_for_each_fence(&cursor, bo->tbo.base.resv,
 					DMA_RESV_USAGE_KERNEL, fence) {
 			ret = amdgpu_sync_fence(&sync_obj, fence);
@@ -2991,6 +3283,10 @@ int amdgpu_amdkfd_gpuvm_restore_process_bos(void *info, struct dma_fence __rcu *
 			    validate_list) {
 		struct kfd_mem_attachment *attachment;
 
+		/* Also catches BOs evicted by the validation above */
+		if (!full_restore && !kfd_mem_needs_restore(mem))
+			continue;
+
 		list_for_each_entry(attachment, &mem->attachments, list) {
 			if (!attachment->is_mapped)
 				continue;
@@ -3002,6 +3298,7 @@ int amdgpu_amdkfd_gpuvm_restore_process_bos(void *info, struct dma_fence __rcu *
 				goto validate_map_fail;
 			}
 		}
+		kfd_mem_restored(mem);
 	}
 
 	/* Update mappings not managed by KFD */
@@ -3085,6 +3382,16 @@ int amdgpu_amdkfd_gpuvm_restore_process_bos(void *info, struct dma_fence __rcu *
 				   DMA_RESV_USAGE_BOOKKEEP);
 	}
 
+	list_for_each_entry(peer_vm, &process_info->vm_list_head,
+			    vm_list_node) {
+		struct amdgpu_device *adev = amdgpu_ttm_adev(
+			peer_vm->root.bo->tbo.bdev);
+
+		atomic64_inc(&adev->kfd.restore_count);
+		atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+			     &adev->kfd.restore_time_ns);
+	}
+
 validate_map_fail:
 	amdgpu_sync_free(&sync_obj);
 ttm_reserve_fail:
@@ -3219,6 +3526,30 @@ bool amdgpu_amdkfd_bo_mapped_to_dev(void *drm_priv, struct kgd_mem *mem)
 
 #if defined(CONFIG_DEBUG_FS)
 
+static int amdgpu_debugfs_kfd_restore_info_show(struct seq_file *m,
+						void *unused)
+{
+	struct amdgpu_device *adev = m->private;
+	u64 count = atomic64_read(&adev->kfd.restore_count);
+	u64 time_ns = atomic64_read(&adev->kfd.restore_time_ns);
+
+	seq_printf(m, "restores:         %llu\n", count);
+	seq_printf(m, "avg latency (us): %llu\n",
+		   count ? div64_u64(time_ns, count * NSEC_PER_USEC) : 0);
+	seq_printf(m, "BOs revalidated:  %lld\n",
+		   atomic64_read(&adev->kfd.restore_bos));
+	seq_printf(m, "bytes moved:      %lld\n",
+		   atomic64_read(&adev->kfd.restore_bytes));
+	seq_printf(m, "userptr quiesce:  %lld\n",
+		   atomic64_read(&adev->kfd.userptr_quiesce));
+	seq_printf(m, "userptr unmap:    %lld\n",
+		   atomic64_read(&adev->kfd.userptr_range_inval));
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(amdgpu_debugfs_kfd_restore_info);
+
 int kfd_debugfs_kfd_mem_limits(struct seq_file *m, void *data)
 {
 
@@ -3235,3 +3566,14 @@ int kfd_debugfs_kfd_mem_limits(struct seq_file *m, void *data)
 }
 
 #endif
+
+void amdgpu_amdkfd_debugfs_init(struct amdgpu_device *adev)
+{
+#if defined(CONFIG_DEBUG_FS)
+	struct drm_minor *minor = adev_to_drm(adev)->primary;
+	struct dentry *root = minor->debugfs_root;
+
+	debugfs_create_file("amdgpu_kfd_restore_info", 0444, root, adev,
+			    &amdgpu_debugfs_kfd_restore_info_fops);
+#endif
+}
@@ -1504,7 +1504,7 @@ int amdgpu_cs_wait_ioctl(struct drm_device *dev, void *data,
 	if (IS_ERR(fence))
 		r = PTR_ERR(fence);
 	else if (fence) {
-		r = dma_fence_wait_timeout(fence, true, timeout);
+		r = amdgpu_fence_wait_hybrid(fence, true, timeout);
 		if (r > 0 && fence->error)
 			r = fence->error;
 		dma_fence_put(fence);
@@ -1641,7 +1641,7 @@ static int amdgpu_cs_wait_all_fences(struct amdgpu_device *adev,
 		else if (!fence)
 			continue;
 
-		r = dma_fence_wait_timeout(fence, true, timeout);
+		r = amdgpu_fence_wait_hybrid(fence, true, timeout);
 		if (r > 0 && fence->error)
 			r = fence->error;
 
@@ -1673,14 +1673,19 @@ static int amdgpu_cs_wait_any_fence(struct amdgpu_device *adev,
 				    struct drm_amdgpu_fence *fences)
 {
 	unsigned long timeout = amdgpu_gem_timeout(wait->in.timeout_ns);
+	struct dma_fence *stack_array[AMDGPU_CS_WAIT_STACK_FENCES] = {};
 	uint32_t fence_count = wait->in.fence_count;
 	uint32_t first = ~0;
 	struct dma_fence **array;
 	unsigned int i;
 	long r;
 
-	/* Prepare the fence array */
-	array = kcalloc(fence_count, sizeof(struct dma_fence *), GFP_KERNEL);
+	/* Prepare the fence array, small waits don't need an allocation */
+	if (fence_count <= ARRAY_SIZE(stack_array))
+		array = stack_array;
+	else
+		array = kcalloc(fence_count, sizeof(struct dma_fence *),
+				GFP_KERNEL);
 
 	if (array == NULL)
 		return -ENOMEM;
@@ -1719,7 +1724,8 @@ out:
 err_free_fence_array:
 	for (i = 0; i < fence_count; i++)
 		dma_fence_put(array[i]);
-	kfree(array);
+	if (array != stack_array)
+		kfree(array);
 
 	return r;
 }
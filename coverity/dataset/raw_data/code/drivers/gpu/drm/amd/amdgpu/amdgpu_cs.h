@@ -32,6 +32,9 @@
 
 #define AMDGPU_CS_GANG_SIZE	4
 
+/* fence waits up to this size are handled without an allocation */
+#define AMDGPU_CS_WAIT_STACK_FENCES	8
+
 struct amdgpu_bo_va_mapping;
 
 struct amdgpu_cs_chunk {
@@ -166,39 +166,86 @@ static unsigned int amdgpu_ctx_get_hw_prio(struct amdgpu_ctx *ctx, u32 hw_ip)
 	return hw_prio;
 }
 
-/* Calculate the time spend on the hw */
-static ktime_t amdgpu_ctx_fence_time(struct dma_fence *fence)
+static void amdgpu_ctx_fence_scheduled(struct dma_fence *fence,
+				       struct dma_fence_cb *cb)
 {
-	struct drm_sched_fence *s_fence;
+	struct amdgpu_ctx_fence_cb *fcb =
+		container_of(cb, struct amdgpu_ctx_fence_cb, scheduled);
+	struct amdgpu_ctx_mgr *mgr = fcb->mgr;
+	unsigned long flags;
+
+	write_seqlock_irqsave(&mgr->busy_lock, flags);
+	mgr->busy_jobs[fcb->hw_ip]++;
+	mgr->busy_start[fcb->hw_ip] += ktime_to_ns(fence->timestamp);
+	fcb->running = true;
+	write_sequnlock_irqrestore(&mgr->busy_lock, flags);
+}
 
-	if (!fence)
-		return ns_to_ktime(0);
+/* Move the time spend on the hw from the in flight to the finished counter */
+static void amdgpu_ctx_fence_account(struct amdgpu_ctx_fence_cb *fcb,
+				     struct drm_sched_fence *s_fence,
+				     ktime_t end)
+{
+	struct amdgpu_ctx_mgr *mgr = fcb->mgr;
+	int64_t start;
 
-	/* When the fence is not even scheduled it can't have spend time */
-	s_fence = to_drm_sched_fence(fence);
-	if (!test_bit(DMA_FENCE_FLAG_TIMESTAMP_BIT, &s_fence->scheduled.flags))
-		return ns_to_ktime(0);
+	if (!fcb->running)
+		return;
 
-	/* When it is still running account how much already spend */
-	if (!test_bit(DMA_FENCE_FLAG_TIMESTAMP_BIT, &s_fence->finished.flags))
-		return ktime_sub(ktime_get(), s_fence->scheduled.timestamp);
+	start = ktime_to_ns(s_fence->scheduled.timestamp);
+	mgr->busy_jobs[fcb->hw_ip]--;
+	mgr->busy_start[fcb->hw_ip] -= start;
+	atomic64_add(ktime_to_ns(end) - start, &mgr->time_spend[fcb->hw_ip]);
+	fcb->running = false;
+}
 
-	return ktime_sub(s_fence->finished.timestamp,
-			 s_fence->scheduled.timestamp);
+static void amdgpu_ctx_fence_finished(struct dma_fence *fence,
+				      struct dma_fence_cb *cb)
+{
+	struct amdgpu_ctx_fence_cb *fcb =
+		container_of(cb, struct amdgpu_ctx_fence_cb, finished);
+	struct amdgpu_ctx_mgr *mgr = fcb->mgr;
+	unsigned long flags;
+
+	write_seqlock_irqsave(&mgr->busy_lock, flags);
+	amdgpu_ctx_fence_account(fcb, to_drm_sched_fence(fence),
+				 fence->timestamp);
+	write_sequnlock_irqrestore(&mgr->busy_lock, flags);
 }
 
-static ktime_t amdgpu_ctx_entity_time(struct amdgpu_ctx *ctx,
-				      struct amdgpu_ctx_entity *centity)
+static void amdgpu_ctx_fence_track(struct amdgpu_ctx_fence_cb *fcb,
+				   struct dma_fence *fence)
 {
-	ktime_t res = ns_to_ktime(0);
-	uint32_t i;
+	struct drm_sched_fence *s_fence = to_drm_sched_fence(fence);
 
-	spin_lock(&ctx->ring_lock);
-	for (i = 0; i < amdgpu_sched_jobs; i++) {
-		res = ktime_add(res, amdgpu_ctx_fence_time(centity->fences[i]));
-	}
-	spin_unlock(&ctx->ring_lock);
-	return res;
+	fcb->running = false;
+	if (dma_fence_add_callback(&s_fence->scheduled, &fcb->scheduled,
+				   amdgpu_ctx_fence_scheduled))
+		amdgpu_ctx_fence_scheduled(&s_fence->scheduled,
+					   &fcb->scheduled);
+
+	if (dma_fence_add_callback(&s_fence->finished, &fcb->finished,
+				   amdgpu_ctx_fence_finished))
+		amdgpu_ctx_fence_finished(&s_fence->finished, &fcb->finished);
+}
+
+/*
+ * Stop tracking a fence, when the job is still running account the time it
+ * already spend on the hw.
+ */
+static void amdgpu_ctx_fence_untrack(struct amdgpu_ctx_fence_cb *fcb,
+				     struct dma_fence *fence)
+{
+	struct drm_sched_fence *s_fence = to_drm_sched_fence(fence);
+	unsigned long flags;
+
+	/* Both fences share the lock the callbacks are called under */
+	dma_fence_remove_callback(&s_fence->scheduled, &fcb->scheduled);
+	dma_fence_remove_callback(&s_fence->finished, &fcb->finished);
+
+	write_seqlock_irqsave(&fcb->mgr->busy_lock, flags);
+	amdgpu_ctx_fence_account(fcb, s_fence, ktime_get());
+	write_sequnlock_irqrestore(&fcb->mgr->busy_lock, flags);
 }
 
 static int amdgpu_ctx_init_entity(struct amdgpu_ctx *ctx, u32 hw_ip,
@@ -217,6 +264,13 @@ static int amdgpu_ctx_init_entity(struct amdgpu_ctx *ctx, u32 hw_ip,
 	if (!entity)
 		return  -ENOMEM;
 
+	entity->fence_cbs = kcalloc(amdgpu_sched_jobs, sizeof(*entity->fence_cbs),
+				    GFP_KERNEL);
+	if (!entity->fence_cbs) {
+		r = -ENOMEM;
+		goto error_free_entity;
+	}
+
 	ctx_prio = (ctx->override_priority == AMDGPU_CTX_PRIORITY_UNSET) ?
 			ctx->init_priority : ctx->override_priority;
 	entity->hw_ip = hw_ip;
@@ -264,29 +318,33 @@ cleanup_entity:
 	drm_sched_entity_fini(&entity->entity);
 
 error_free_entity:
+	kfree(entity->fence_cbs);
 	kfree(entity);
 
 	return r;
 }
 
-static ktime_t amdgpu_ctx_fini_entity(struct amdgpu_device *adev,
-				  struct amdgpu_ctx_entity *entity)
+static void amdgpu_ctx_fini_entity(struct amdgpu_device *adev,
+				   struct amdgpu_ctx_entity *entity)
 {
-	ktime_t res = ns_to_ktime(0);
 	int i;
 
 	if (!entity)
-		return res;
+		return;
 
 	for (i = 0; i < amdgpu_sched_jobs; ++i) {
-		res = ktime_add(res, amdgpu_ctx_fence_time(entity->fences[i]));
+		if (!entity->fences[i])
+			continue;
+
+		amdgpu_ctx_fence_untrack(&entity->fence_cbs[i],
+					 entity->fences[i]);
 		dma_fence_put(entity->fences[i]);
 	}
 
 	amdgpu_xcp_release_sched(adev, entity);
 
+	kfree(entity->fence_cbs);
 	kfree(entity);
-	return res;
 }
 
 static int amdgpu_ctx_get_stable_pstate(struct amdgpu_ctx *ctx,
@@ -415,12 +473,8 @@ static void amdgpu_ctx_fini(struct kref *ref)
 		return;
 
 	for (i = 0; i < AMDGPU_HW_IP_NUM; ++i) {
-		for (j = 0; j < AMDGPU_MAX_ENTITY_NUM; ++j) {
-			ktime_t spend;
-
-			spend = amdgpu_ctx_fini_entity(adev, ctx->entities[i][j]);
-			atomic64_add(ktime_to_ns(spend), &mgr->time_spend[i]);
-		}
+		for (j = 0; j < AMDGPU_MAX_ENTITY_NUM; ++j)
+			amdgpu_ctx_fini_entity(adev, ctx->entities[i][j]);
 	}
 
 	if (drm_dev_enter(adev_to_drm(adev), &idx)) {
@@ -760,6 +814,7 @@ uint64_t amdgpu_ctx_add_fence(struct amdgpu_ctx *ctx,
 {
 	struct amdgpu_ctx_entity *centity = to_amdgpu_ctx_entity(entity);
 	uint64_t seq = centity->sequence;
+	struct amdgpu_ctx_fence_cb *fcb;
 	struct dma_fence *other = NULL;
 	unsigned idx = 0;
 
@@ -767,6 +822,14 @@ uint64_t amdgpu_ctx_add_fence(struct amdgpu_ctx *ctx,
 	other = centity->fences[idx];
 	WARN_ON(other && !dma_fence_is_signaled(other));
 
+	fcb = &centity->fence_cbs[idx];
+	if (other)
+		amdgpu_ctx_fence_untrack(fcb, other);
+
+	fcb->mgr = ctx->mgr;
+	fcb->hw_ip = centity->hw_ip;
+	amdgpu_ctx_fence_track(fcb, fence);
+
 	dma_fence_get(fence);
 
 	spin_lock(&ctx->ring_lock);
@@ -774,9 +837,6 @@ uint64_t amdgpu_ctx_add_fence(struct amdgpu_ctx *ctx,
 	centity->sequence++;
 	spin_unlock(&ctx->ring_lock);
 
-	atomic64_add(ktime_to_ns(amdgpu_ctx_fence_time(other)),
-		     &ctx->mgr->time_spend[centity->hw_ip]);
-
 	dma_fence_put(other);
 	return seq;
 }
@@ -888,9 +948,13 @@ void amdgpu_ctx_mgr_init(struct amdgpu_ctx_mgr *mgr,
 	mgr->adev = adev;
 	mutex_init(&mgr->lock);
 	idr_init_base(&mgr->ctx_handles, 1);
+	seqlock_init(&mgr->busy_lock);
 
-	for (i = 0; i < AMDGPU_HW_IP_NUM; ++i)
+	for (i = 0; i < AMDGPU_HW_IP_NUM; ++i) {
 		atomic64_set(&mgr->time_spend[i], 0);
+		mgr->busy_jobs[i] = 0;
+		mgr->busy_start[i] = 0;
+	}
 }
 
 long amdgpu_ctx_mgr_entity_flush(struct amdgpu_ctx_mgr *mgr, long timeout)
@@ -969,35 +1033,21 @@ void amdgpu_ctx_mgr_fini(struct amdgpu_ctx_mgr *mgr)
 void amdgpu_ctx_mgr_usage(struct amdgpu_ctx_mgr *mgr,
 			  ktime_t usage[AMDGPU_HW_IP_NUM])
 {
-	struct amdgpu_ctx *ctx;
-	unsigned int hw_ip, i;
-	uint32_t id;
+	unsigned int hw_ip, seq;
+	int64_t now, ns;
 
 	/*
-	 * This is a little bit racy because it can be that a ctx or a fence are
-	 * destroyed just in the moment we try to account them. But that is ok
-	 * since exactly that case is explicitely allowed by the interface.
+	 * The time of finished jobs is accumulated when their fence signals,
+	 * jobs still running on the hw are accounted up to now.
 	 */
-	mutex_lock(&mgr->lock);
-	for (hw_ip = 0; hw_ip < AMDGPU_HW_IP_NUM; ++hw_ip) {
-		uint64_t ns = atomic64_read(&mgr->time_spend[hw_ip]);
-
-		usage[hw_ip] = ns_to_ktime(ns);
-	}
-
-	idr_for_each_entry(&mgr->ctx_handles, ctx, id) {
+	do {
+		seq = read_seqbegin(&mgr->busy_lock);
+		now = ktime_get_ns();
 		for (hw_ip = 0; hw_ip < AMDGPU_HW_IP_NUM; ++hw_ip) {
-			for (i = 0; i < amdgpu_ctx_num_entities[hw_ip]; ++i) {
-				struct amdgpu_ctx_entity *centity;
-				ktime_t spend;
-
-				centity = ctx->entities[hw_ip][i];
-				if (!centity)
-					continue;
-				spend = amdgpu_ctx_entity_time(ctx, centity);
-				usage[hw_ip] = ktime_add(usage[hw_ip], spend);
-			}
+			ns = atomic64_read(&mgr->time_spend[hw_ip]);
+			ns += mgr->busy_jobs[hw_ip] * now -
+				mgr->busy_start[hw_ip];
+			usage[hw_ip] = ns_to_ktime(ns);
 		}
-	}
-	mutex_unlock(&mgr->lock);
+	} while (read_seqretry(&mgr->busy_lock, seq));
 }
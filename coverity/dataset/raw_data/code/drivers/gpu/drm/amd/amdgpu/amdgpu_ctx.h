@@ -24,6 +24,7 @@
 #define __AMDGPU_CTX_H__
 
 #include <linux/ktime.h>
+#include <linux/seqlock.h>
 #include <linux/types.h>
 
 #include "amdgpu_ring.h"
@@ -35,10 +36,21 @@ struct amdgpu_ctx_mgr;
 
 #define AMDGPU_MAX_ENTITY_NUM 4
 
+/* Busy time accounting for a submitted job, one per fence slot */
+struct amdgpu_ctx_fence_cb {
+	struct dma_fence_cb	scheduled;
+	struct dma_fence_cb	finished;
+	struct amdgpu_ctx_mgr	*mgr;
+	uint32_t		hw_ip;
+	/* the job is executing and counted in mgr->busy_jobs */
+	bool			running;
+};
+
 struct amdgpu_ctx_entity {
 	uint32_t		hw_ip;
 	uint64_t		sequence;
 	struct drm_sched_entity	entity;
+	struct amdgpu_ctx_fence_cb *fence_cbs;
 	struct dma_fence	*fences[];
 };
 
@@ -65,7 +77,12 @@ struct amdgpu_ctx_mgr {
 	struct mutex		lock;
 	/* protected by lock */
 	struct idr		ctx_handles;
+	/* protects the busy time accounting below */
+	seqlock_t		busy_lock;
 	atomic64_t		time_spend[AMDGPU_HW_IP_NUM];
+	/* number of executing jobs and the sum of their start times in ns */
+	uint32_t		busy_jobs[AMDGPU_HW_IP_NUM];
+	int64_t			busy_start[AMDGPU_HW_IP_NUM];
 };
 
 extern const unsigned int amdgpu_ctx_num_entities[AMDGPU_HW_IP_NUM];
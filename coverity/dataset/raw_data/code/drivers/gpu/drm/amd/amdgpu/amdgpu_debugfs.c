@@ -231,9 +231,10 @@ static ssize_t amdgpu_debugfs_regs2_op(struct file *f, char __user *buf, u32 off
 {
 	struct amdgpu_debugfs_regs2_data *rd = f->private_data;
 	struct amdgpu_device *adev = rd->adev;
+	uint32_t regs[AMDGPU_KIQ_REG_BATCH];
 	ssize_t result = 0;
+	uint32_t value, i, n;
 	int r;
-	uint32_t value;
 
 	if (size & 0x3 || offset & 0x3)
 		return -EINVAL;
@@ -278,9 +279,14 @@ static ssize_t amdgpu_debugfs_regs2_op(struct file *f, char __user *buf, u32 off
 
 	while (size) {
 		if (!write_en) {
-			value = RREG32(offset >> 2);
-			r = put_user(value, (uint32_t *)buf);
+			/* read a chunk at once so SR-IOV can batch the KIQ accesses */
+			n = min_t(size_t, size >> 2, ARRAY_SIZE(regs));
+			for (i = 0; i < n; i++)
+				regs[i] = (offset >> 2) + i;
+			amdgpu_device_rreg_batch(adev, regs, regs, n);
+			r = copy_to_user(buf, regs, n * 4) ? -EFAULT : 0;
 		} else {
+			n = 1;
 			r = get_user(value, (uint32_t *)buf);
 			if (!r)
 				amdgpu_mm_wreg_mmio_rlc(adev, offset >> 2, value, rd->id.xcc_id);
@@ -289,10 +295,10 @@ static ssize_t amdgpu_debugfs_regs2_op(struct file *f, char __user *buf, u32 off
 			result = r;
 			goto end;
 		}
-		offset += 4;
-		size -= 4;
-		result += 4;
-		buf += 4;
+		offset += n * 4;
+		size -= n * 4;
+		result += n * 4;
+		buf += n * 4;
 	}
 end:
 	if (rd->id.use_grbm) {
@@ -1775,6 +1781,16 @@ static int amdgpu_debugfs_vm_info_show(struct seq_file *m, void *unused)
 	struct drm_file *file;
 	int r;
 
+	seq_printf(m, "TLB flushes requested: %lld issued: %lld\n",
+		   atomic64_read(&adev->vm_manager.tlb_flush_requested),
+		   atomic64_read(&adev->vm_manager.tlb_flush_issued));
+	seq_printf(m, "Page tables created: %lld reused: %lld freed: %lld\n",
+		   atomic64_read(&adev->vm_manager.pt_created),
+		   atomic64_read(&adev->vm_manager.pt_reused),
+		   atomic64_read(&adev->vm_manager.pt_freed));
+	seq_printf(m, "Page table memory: %lld KiB\n",
+		   atomic64_read(&adev->vm_manager.pt_bytes) >> 10);
+
 	r = mutex_lock_interruptible(&dev->filelist_mutex);
 	if (r)
 		return r;
@@ -1802,8 +1818,33 @@ static int amdgpu_debugfs_vm_info_show(struct seq_file *m, void *unused)
 	return r;
 }
 
+static int amdgpu_debugfs_kiq_info_show(struct seq_file *m, void *unused)
+{
+	struct amdgpu_device *adev = m->private;
+	int num_xcc = adev->gfx.xcc_mask ? NUM_XCC(adev->gfx.xcc_mask) : 1;
+	struct amdgpu_kiq_stats *stats;
+	u64 submissions, wait_us;
+	int i;
+
+	for (i = 0; i < num_xcc; i++) {
+		stats = &adev->gfx.kiq[i].stats;
+		submissions = atomic64_read(&stats->submissions);
+		wait_us = atomic64_read(&stats->wait_us);
+
+		seq_printf(m, "xcc %d: submissions: %llu regs: %lld timeouts: %lld\n",
+			   i, submissions, atomic64_read(&stats->regs),
+			   atomic64_read(&stats->timeouts));
+		seq_printf(m, "xcc %d: wait total: %llu us avg: %llu us\n", i,
+			   wait_us,
+			   submissions ? div64_u64(wait_us, submissions) : 0);
+	}
+
+	return 0;
+}
+
 DEFINE_SHOW_ATTRIBUTE(amdgpu_debugfs_test_ib);
 DEFINE_SHOW_ATTRIBUTE(amdgpu_debugfs_vm_info);
+DEFINE_SHOW_ATTRIBUTE(amdgpu_debugfs_kiq_info);
 DEFINE_DEBUGFS_ATTRIBUTE(amdgpu_evict_vram_fops, amdgpu_debugfs_evict_vram,
 			 NULL, "%lld\n");
 DEFINE_DEBUGFS_ATTRIBUTE(amdgpu_evict_gtt_fops, amdgpu_debugfs_evict_gtt,
@@ -2058,6 +2099,8 @@ int amdgpu_debugfs_init(struct amdgpu_device *adev)
 	amdgpu_debugfs_sa_init(adev);
 	amdgpu_debugfs_fence_init(adev);
 	amdgpu_debugfs_gem_init(adev);
+	amdgpu_debugfs_vmid_init(adev);
+	amdgpu_amdkfd_debugfs_init(adev);
 
 	r = amdgpu_debugfs_regs_init(adev);
 	if (r)
@@ -2108,6 +2151,8 @@ int amdgpu_debugfs_init(struct amdgpu_device *adev)
 			    &amdgpu_debugfs_test_ib_fops);
 	debugfs_create_file("amdgpu_vm_info", 0444, root, adev,
 			    &amdgpu_debugfs_vm_info_fops);
+	debugfs_create_file("amdgpu_kiq_info", 0444, root, adev,
+			    &amdgpu_debugfs_kiq_info_fops);
 	debugfs_create_file("amdgpu_benchmark", 0200, root, adev,
 			    &amdgpu_benchmark_fops);
 
@@ -629,6 +629,41 @@ uint32_t amdgpu_device_rreg(struct amdgpu_device *adev,
 	return ret;
 }
 
+/**
+ * amdgpu_device_rreg_batch - read a list of registers
+ *
+ * @adev: amdgpu_device pointer
+ * @regs: dword aligned register offsets
+ * @vals: the register values read, may alias @regs
+ * @count: number of registers
+ *
+ * Equal to calling amdgpu_device_rreg() for each register, but under SR-IOV
+ * runtime the whole list goes through the KIQ in batches instead of paying a
+ * full KIQ round trip for every register.
+ */
+void amdgpu_device_rreg_batch(struct amdgpu_device *adev, const uint32_t *regs,
+			      uint32_t *vals, uint32_t count)
+{
+	uint32_t i;
+
+	if (amdgpu_sriov_runtime(adev) &&
+	    down_read_trylock(&adev->reset_domain->sem)) {
+		for (i = 0; i < count; i++)
+			if ((regs[i] * 4) >= adev->rmmio_size)
+				break;
+
+		if (i == count) {
+			amdgpu_kiq_rreg_batch(adev, regs, vals, count, 0);
+			up_read(&adev->reset_domain->sem);
+			return;
+		}
+		up_read(&adev->reset_domain->sem);
+	}
+
+	for (i = 0; i < count; i++)
+		vals[i] = amdgpu_device_rreg(adev, regs[i], 0);
+}
+
 /*
  * MMIO register read with bytes helper functions
  * @offset:bytes offset from MMIO start
@@ -4134,7 +4169,11 @@ int amdgpu_device_init(struct amdgpu_device *adev,
 				  amdgpu_gfx_enforce_isolation_handler);
 		adev->gfx.enforce_isolation[i].adev = adev;
 		adev->gfx.enforce_isolation[i].xcp_id = i;
+		adev->gfx.enforce_isolation[i].weight =
+			AMDGPU_ISOLATION_WEIGHT_DEFAULT;
+		adev->gfx.enforce_isolation[i].mode_start = ktime_get();
 	}
+	adev->gfx.cleaner_shader_policy = AMDGPU_CLEANER_SHADER_OWNER_CHANGE;
 
 	INIT_WORK(&adev->xgmi_reset_work, amdgpu_device_xgmi_reset_func);
 
@@ -5029,6 +5068,47 @@ static int amdgpu_device_ip_post_soft_reset(struct amdgpu_device *adev)
 	return 0;
 }
 
+/* Upper limit for the IB size of a single shadow restore batch */
+#define AMDGPU_RECOVER_VRAM_BATCH_DW	(16 * 1024)
+
+static struct amdgpu_bo *amdgpu_device_recover_vram_shadow(struct amdgpu_bo_vm *vmbo)
+{
+	struct amdgpu_bo *shadow = vmbo->shadow;
+
+	/* If vm is compute context or adev is APU, shadow will be NULL */
+	if (!shadow)
+		return NULL;
+
+	/* No need to recover an evicted BO */
+	if (!shadow->tbo.resource ||
+	    shadow->tbo.resource->mem_type != TTM_PL_TT ||
+	    shadow->tbo.resource->start == AMDGPU_BO_INVALID_OFFSET ||
+	    shadow->parent->tbo.resource->mem_type != TTM_PL_VRAM)
+		return NULL;
+
+	return shadow;
+}
+
+static int amdgpu_device_recover_vram_submit(struct amdgpu_ring *ring,
+					     struct amdgpu_job *job,
+					     struct dma_fence **fence)
+{
+	struct dma_fence *f;
+	int r;
+
+	amdgpu_ring_pad_ib(ring, &job->ibs[0]);
+	r = amdgpu_job_submit_direct(job, ring, &f);
+	if (r) {
+		amdgpu_job_free(job);
+		return r;
+	}
+
+	/* jobs on the same ring complete in order, only keep the last one */
+	dma_fence_put(*fence);
+	*fence = f;
+	return 0;
+}
+
 /**
  * amdgpu_device_recover_vram - Recover some VRAM contents
  *
@@ -5038,67 +5118,115 @@ static int amdgpu_device_ip_post_soft_reset(struct amdgpu_device *adev)
  * restore things like GPUVM page tables after a GPU reset where
  * the contents of VRAM might be lost.
  *
+ * The copies are gathered into large IBs which are spread over all working
+ * SDMA rings, and we only wait for the last fence of each ring at the end.
+ *
  * Returns:
  * 0 on success, negative error code on failure.
  */
 static int amdgpu_device_recover_vram(struct amdgpu_device *adev)
 {
-	struct dma_fence *fence = NULL, *next = NULL;
+	struct dma_fence *fences[AMDGPU_MAX_SDMA_INSTANCES] = {};
+	struct amdgpu_ring *rings[AMDGPU_MAX_SDMA_INSTANCES];
+	unsigned int num_rings = 0, num_bos = 0, num_jobs = 0, i;
+	struct amdgpu_job *job = NULL;
 	struct amdgpu_bo *shadow;
 	struct amdgpu_bo_vm *vmbo;
-	long r = 1, tmo;
+	struct amdgpu_ring *ring;
+	ktime_t start, submitted;
+	u64 total_dw = 0, dw;
+	long r = 0, tmo;
 
 	if (amdgpu_sriov_runtime(adev))
 		tmo = msecs_to_jiffies(8000);
 	else
 		tmo = msecs_to_jiffies(100);
 
+	rings[num_rings++] = adev->mman.buffer_funcs_ring;
+	for (i = 0; i < adev->sdma.num_instances; i++) {
+		ring = adev->sdma.has_page_queue ? &adev->sdma.instance[i].page :
+			&adev->sdma.instance[i].ring;
+		if (ring != adev->mman.buffer_funcs_ring && ring->sched.ready)
+			rings[num_rings++] = ring;
+	}
+
 	dev_info(adev->dev, "recover vram bo from shadow start\n");
+	start = ktime_get();
 	mutex_lock(&adev->shadow_list_lock);
 	list_for_each_entry(vmbo, &adev->shadow_list, shadow_list) {
-		/* If vm is compute context or adev is APU, shadow will be NULL */
-		if (!vmbo->shadow)
-			continue;
-		shadow = vmbo->shadow;
+		shadow = amdgpu_device_recover_vram_shadow(vmbo);
+		if (shadow)
+			total_dw += amdgpu_bo_restore_shadow(shadow, NULL);
+	}
 
-		/* No need to recover an evicted BO */
-		if (!shadow->tbo.resource ||
-		    shadow->tbo.resource->mem_type != TTM_PL_TT ||
-		    shadow->tbo.resource->start == AMDGPU_BO_INVALID_OFFSET ||
-		    shadow->parent->tbo.resource->mem_type != TTM_PL_VRAM)
+	list_for_each_entry(vmbo, &adev->shadow_list, shadow_list) {
+		shadow = amdgpu_device_recover_vram_shadow(vmbo);
+		if (!shadow)
 			continue;
 
-		r = amdgpu_bo_restore_shadow(shadow, &next);
-		if (r)
-			break;
-
-		if (fence) {
-			tmo = dma_fence_wait_timeout(fence, false, tmo);
-			dma_fence_put(fence);
-			fence = next;
-			if (tmo == 0) {
-				r = -ETIMEDOUT;
+		dw = amdgpu_bo_restore_shadow(shadow, NULL);
+		if (job && job->ibs[0].length_dw + dw > AMDGPU_RECOVER_VRAM_BATCH_DW) {
+			ring = rings[num_jobs % num_rings];
+			r = amdgpu_device_recover_vram_submit(ring, job,
+						&fences[num_jobs % num_rings]);
+			job = NULL;
+			if (r)
 				break;
-			} else if (tmo < 0) {
-				r = tmo;
+			++num_jobs;
+		}
+
+		if (!job) {
+			/* leave room for the padding at the end of the IB */
+			r = amdgpu_job_alloc_with_ib(adev, &adev->mman.high_pr,
+				AMDGPU_FENCE_OWNER_UNDEFINED,
+				(max(dw, min_t(u64, total_dw,
+					       AMDGPU_RECOVER_VRAM_BATCH_DW)) + 8) * 4,
+				AMDGPU_IB_POOL_DIRECT, &job);
+			if (r) {
+				job = NULL;
 				break;
 			}
-		} else {
-			fence = next;
 		}
+
+		amdgpu_bo_restore_shadow(shadow, &job->ibs[0]);
+		total_dw -= dw;
+		++num_bos;
+	}
+
+	if (job) {
+		ring = rings[num_jobs % num_rings];
+		r = amdgpu_device_recover_vram_submit(ring, job,
+						      &fences[num_jobs % num_rings]);
+		if (!r)
+			++num_jobs;
 	}
 	mutex_unlock(&adev->shadow_list_lock);
+	submitted = ktime_get();
+
+	/* wait for everything submitted, even when something failed */
+	for (i = 0; i < num_rings; i++) {
+		long t;
 
-	if (fence)
-		tmo = dma_fence_wait_timeout(fence, false, tmo);
-	dma_fence_put(fence);
+		if (!fences[i])
+			continue;
+
+		t = dma_fence_wait_timeout(fences[i], false, tmo);
+		dma_fence_put(fences[i]);
+		if (!r && t == 0)
+			r = -ETIMEDOUT;
+		else if (!r && t < 0)
+			r = t;
+	}
 
-	if (r < 0 || tmo <= 0) {
-		dev_err(adev->dev, "recover vram bo from shadow failed, r is %ld, tmo is %ld\n", r, tmo);
+	if (r < 0) {
+		dev_err(adev->dev, "recover vram bo from shadow failed, r is %ld\n", r);
 		return -EIO;
 	}
 
-	dev_info(adev->dev, "recover vram bo from shadow done\n");
+	dev_info(adev->dev, "recover vram bo from shadow done, %u BOs in %u IBs on %u rings, submit %lld us, wait %lld us\n",
+		 num_bos, num_jobs, min(num_jobs, num_rings),
+		 ktime_us_delta(submitted, start),
+		 ktime_us_delta(ktime_get(), submitted));
 	return 0;
 }
 
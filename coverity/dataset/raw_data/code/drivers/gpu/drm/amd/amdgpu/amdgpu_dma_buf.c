@@ -42,6 +42,20 @@
 #include <linux/dma-fence-array.h>
 #include <linux/pci-p2pdma.h>
 
+/*
+ * Exporter state of an attachment. Importers tend to map and unmap the same
+ * buffer over and over again, so keep the last sg table around until the BO
+ * moves instead of rebuilding it on every map.
+ */
+struct amdgpu_dma_buf_attach_priv {
+	struct sg_table		*sgt;
+	enum dma_data_direction	dir;
+	/* bo->move_seq the sg table was created for */
+	u64			move_seq;
+	/* the sg table is currently handed out to the importer */
+	bool			mapped;
+};
+
 /**
  * amdgpu_dma_buf_attach - &dma_buf_ops.attach implementation
  *
@@ -57,12 +71,74 @@ static int amdgpu_dma_buf_attach(struct dma_buf *dmabuf,
 	struct amdgpu_bo *bo = gem_to_amdgpu_bo(obj);
 	struct amdgpu_device *adev = amdgpu_ttm_adev(bo->tbo.bdev);
 
+	attach->priv = kzalloc(sizeof(struct amdgpu_dma_buf_attach_priv),
+			       GFP_KERNEL);
+	if (!attach->priv)
+		return -ENOMEM;
+
 	if (pci_p2pdma_distance(adev->pdev, attach->dev, false) < 0)
 		attach->peer2peer = false;
 
 	return 0;
 }
 
+static void amdgpu_dma_buf_free_sgt(struct dma_buf_attachment *attach,
+				    struct sg_table *sgt,
+				    enum dma_data_direction dir)
+{
+	if (sgt->sgl->page_link) {
+		dma_unmap_sgtable(attach->dev, sgt, dir, 0);
+		sg_free_table(sgt);
+		kfree(sgt);
+	} else {
+		amdgpu_vram_mgr_free_sgt(attach->dev, dir, sgt);
+	}
+}
+
+/**
+ * amdgpu_dma_buf_detach - &dma_buf_ops.detach implementation
+ *
+ * @dmabuf: DMA-buf where we detach from
+ * @attach: attachment to remove
+ *
+ * Free the cached sg table of the attachment.
+ */
+static void amdgpu_dma_buf_detach(struct dma_buf *dmabuf,
+				  struct dma_buf_attachment *attach)
+{
+	struct amdgpu_dma_buf_attach_priv *priv = attach->priv;
+
+	if (priv->sgt)
+		amdgpu_dma_buf_free_sgt(attach, priv->sgt, priv->dir);
+	kfree(priv);
+}
+
+/**
+ * amdgpu_dma_buf_invalidate_sgt - drop cached sg tables of an exported BO
+ *
+ * @bo: the exported BO which is about to move
+ *
+ * Called from the move notifier with the reservation lock held. Tables which
+ * are still mapped by an importer are freed on unmap instead.
+ */
+void amdgpu_dma_buf_invalidate_sgt(struct amdgpu_bo *bo)
+{
+	struct dma_buf *dmabuf = bo->tbo.base.dma_buf;
+	struct amdgpu_dma_buf_attach_priv *priv;
+	struct dma_buf_attachment *attach;
+
+	dma_resv_assert_held(dmabuf->resv);
+
+	list_for_each_entry(attach, &dmabuf->attachments, node) {
+		priv = attach->priv;
+		if (!priv->sgt || priv->mapped)
+			continue;
+
+		amdgpu_dma_buf_free_sgt(attach, priv->sgt, priv->dir);
+		priv->sgt = NULL;
+	}
+}
+
 /**
  * amdgpu_dma_buf_pin - &dma_buf_ops.pin implementation
  *
@@ -114,6 +190,7 @@ static struct sg_table *amdgpu_dma_buf_map(struct dma_buf_attachment *attach,
 	struct drm_gem_object *obj = dma_buf->priv;
 	struct amdgpu_bo *bo = gem_to_amdgpu_bo(obj);
 	struct amdgpu_device *adev = amdgpu_ttm_adev(bo->tbo.bdev);
+	struct amdgpu_dma_buf_attach_priv *priv = attach->priv;
 	struct sg_table *sgt;
 	long r;
 
@@ -136,6 +213,17 @@ static struct sg_table *amdgpu_dma_buf_map(struct dma_buf_attachment *attach,
 		return ERR_PTR(-EBUSY);
 	}
 
+	if (priv->sgt && !priv->mapped) {
+		if (priv->dir == dir && priv->move_seq == bo->move_seq) {
+			atomic64_inc(&adev->mman.dmabuf_map_hits);
+			priv->mapped = true;
+			return priv->sgt;
+		}
+
+		amdgpu_dma_buf_free_sgt(attach, priv->sgt, priv->dir);
+		priv->sgt = NULL;
+	}
+
 	switch (bo->tbo.resource->mem_type) {
 	case TTM_PL_TT:
 		sgt = drm_prime_pages_to_sg(obj->dev,
@@ -160,6 +248,17 @@ static struct sg_table *amdgpu_dma_buf_map(struct dma_buf_attachment *attach,
 		return ERR_PTR(-EINVAL);
 	}
 
+	atomic64_inc(&adev->mman.dmabuf_map_misses);
+	atomic64_add(sgt->nents, &adev->mman.dmabuf_sg_segments);
+	atomic64_add(bo->tbo.base.size, &adev->mman.dmabuf_sg_bytes);
+
+	if (!priv->sgt) {
+		priv->sgt = sgt;
+		priv->dir = dir;
+		priv->move_seq = bo->move_seq;
+		priv->mapped = true;
+	}
+
 	return sgt;
 
 error_free:
@@ -175,19 +274,25 @@ error_free:
  * @dir: DMA direction
  *
  * This is called when a shared DMA buffer no longer needs to be accessible by
- * another device. For now, simply unpins the buffer from GTT.
+ * another device. The sg table is kept cached for the next map as long as the
+ * BO didn't move in the meantime.
  */
 static void amdgpu_dma_buf_unmap(struct dma_buf_attachment *attach,
 				 struct sg_table *sgt,
 				 enum dma_data_direction dir)
 {
-	if (sgt->sgl->page_link) {
-		dma_unmap_sgtable(attach->dev, sgt, dir, 0);
-		sg_free_table(sgt);
-		kfree(sgt);
-	} else {
-		amdgpu_vram_mgr_free_sgt(attach->dev, dir, sgt);
+	struct amdgpu_bo *bo = gem_to_amdgpu_bo(attach->dmabuf->priv);
+	struct amdgpu_dma_buf_attach_priv *priv = attach->priv;
+
+	if (sgt == priv->sgt) {
+		priv->mapped = false;
+		if (priv->move_seq == bo->move_seq)
+			return;
+
+		priv->sgt = NULL;
 	}
+
+	amdgpu_dma_buf_free_sgt(attach, sgt, dir);
 }
 
 /**
@@ -233,6 +338,7 @@ static int amdgpu_dma_buf_begin_cpu_access(struct dma_buf *dma_buf,
 
 const struct dma_buf_ops amdgpu_dmabuf_ops = {
 	.attach = amdgpu_dma_buf_attach,
+	.detach = amdgpu_dma_buf_detach,
 	.pin = amdgpu_dma_buf_pin,
 	.unpin = amdgpu_dma_buf_unpin,
 	.map_dma_buf = amdgpu_dma_buf_map,
@@ -33,6 +33,7 @@
 
 #include <linux/cc_platform.h>
 #include <linux/dynamic_debug.h>
+#include <linux/huge_mm.h>
 #include <linux/module.h>
 #include <linux/mmu_notifier.h>
 #include <linux/pm_runtime.h>
@@ -161,6 +162,13 @@ int amdgpu_exp_hw_support;
 int amdgpu_dc = -1;
 int amdgpu_sched_jobs = 32;
 int amdgpu_sched_hw_submission = 2;
+int amdgpu_hang_watchdog;
+uint amdgpu_hang_stall_ms = 2000;
+uint amdgpu_fence_poll_us;
+uint amdgpu_fence_deferred_signal;
+int amdgpu_gtt_numa = -1;
+uint amdgpu_ras_cache_ms;
+int amdgpu_huge_mmap;
 uint amdgpu_pcie_gen_cap;
 uint amdgpu_pcie_lane_cap;
 u64 amdgpu_cg_mask = 0xffffffffffffffff;
@@ -483,6 +491,87 @@ module_param_named(sched_jobs, amdgpu_sched_jobs, int, 0444);
 MODULE_PARM_DESC(sched_hw_submission, "the max number of HW submissions (default 2)");
 module_param_named(sched_hw_submission, amdgpu_sched_hw_submission, int, 0444);
 
+/**
+ * DOC: hang_watchdog (int)
+ * Sample the forward progress of every scheduled ring at this interval in ms.
+ * A ring which still signals fences or advances its read pointer when its
+ * lockup timeout expires gets the timeout extended, while a ring with pending
+ * work which makes no progress at all for hang_stall_ms is declared hung
+ * without waiting for the lockup timeout. The default is 0 (disabled).
+ */
+MODULE_PARM_DESC(hang_watchdog, "ring progress sample interval in ms (0 = disabled (default))");
+module_param_named(hang_watchdog, amdgpu_hang_watchdog, int, 0444);
+
+/**
+ * DOC: hang_stall_ms (uint)
+ * With the hang watchdog enabled, declare a ring hung after it made no
+ * progress for this long in ms. Single dispatches which run longer than this
+ * without the CP fetching further commands look the same and are reset too,
+ * raise this for such workloads. Thresholds which aren't below the lockup
+ * timeout of a ring leave it to the lockup timeout. The default is 2000.
+ */
+MODULE_PARM_DESC(hang_stall_ms, "declare a ring without progress hung after this many ms (default 2000)");
+module_param_named(hang_stall_ms, amdgpu_hang_stall_ms, uint, 0444);
+
+/**
+ * DOC: fence_poll_us (uint)
+ * Busy poll the fence memory of the ring for up to this many microseconds
+ * before going to sleep in the CS wait ioctls. The actual poll window is
+ * derived from how long recent waits on the same ring took, waits which are
+ * expected to take longer than this go to sleep right away. Trades CPU time
+ * for lower wait latency of short jobs. Values above 1000 are clamped to
+ * 1000. The default is 0 (disabled).
+ */
+MODULE_PARM_DESC(fence_poll_us, "max time to busy poll CS fence waits in us (0 = disabled (default), max 1000)");
+module_param_named(fence_poll_us, amdgpu_fence_poll_us, uint, 0644);
+
+/**
+ * DOC: fence_deferred_signal (hexint)
+ * Bitmask of ring types (1 << AMDGPU_RING_TYPE_*) whose fences are signaled
+ * from a high priority worker instead of the interrupt handler. The interrupt
+ * handler then only records the new sequence number and the worker signals
+ * all completed fences in one batch, which keeps fence callbacks out of the
+ * interrupt handler during bursts of small jobs. E.g. 0x3 for GFX and
+ * compute. The default is 0 (signal from the interrupt handler).
+ */
+MODULE_PARM_DESC(fence_deferred_signal, "ring types to signal fences from a worker (bitmask of 1 << ring type, 0 = none (default))");
+module_param_named(fence_deferred_signal, amdgpu_fence_deferred_signal, hexint, 0444);
+
+/**
+ * DOC: gtt_numa (int)
+ * NUMA placement of the system memory backing GTT buffers on dGPUs.
+ * 0 = use the device global page pool, 1 = prefer the NUMA node the device is
+ * attached to, 2 = prefer the NUMA node of the process allocating the
+ * buffer. Allocations fall back to other nodes when the preferred one is out
+ * of memory. The default is -1 (auto), which is 1 on multi node systems.
+ * APUs with memory partitions always use the per partition pools.
+ */
+MODULE_PARM_DESC(gtt_numa, "GTT NUMA placement (-1 = auto (default), 0 = off, 1 = device node, 2 = process node)");
+module_param_named(gtt_numa, amdgpu_gtt_numa, int, 0444);
+
+/**
+ * DOC: ras_cache_ms (uint)
+ * Refresh the RAS error counters of all blocks from a background worker
+ * every this many milliseconds, and right after RAS interrupts, instead of
+ * querying the hardware (and on ACA parts the SMU) on every read of the
+ * error count sysfs files. Reads are then served from the cache and report
+ * the age of the counters. The default is 0 (query on every read).
+ */
+MODULE_PARM_DESC(ras_cache_ms, "RAS error counter cache refresh interval in ms (0 = query on read (default))");
+module_param_named(ras_cache_ms, amdgpu_ras_cache_ms, uint, 0444);
+
+/**
+ * DOC: huge_mmap (int)
+ * Map CPU visible VRAM into user space with 2MiB PMD or 1GiB PUD entries
+ * where the BO is physically contiguous and aligned for it, instead of single
+ * pages. 0 = disabled (default), 1 = 2MiB mappings, 2 = 2MiB and 1GiB mappings,
+ * which also makes the VRAM manager allocate BOs requiring CPU access in 1GiB
+ * blocks where their size allows. Needs transparent huge pages enabled for the
+ * mapping and architecture support for huge PFN mappings.
+ */
+MODULE_PARM_DESC(huge_mmap, "huge CPU mappings of VRAM (0 = disabled (default), 1 = 2MiB, 2 = 2MiB and 1GiB)");
+module_param_named(huge_mmap, amdgpu_huge_mmap, int, 0444);
+
 /**
  * DOC: ppfeaturemask (hexint)
  * Override power features enabled. See enum PP_FEATURE_MASK in drivers/gpu/drm/amd/include/amd_shared.h.
@@ -838,6 +927,18 @@ bool no_system_mem_limit;
 module_param(no_system_mem_limit, bool, 0644);
 MODULE_PARM_DESC(no_system_mem_limit, "disable system memory limit (false = default)");
 
+/**
+ * DOC: userptr_range_inval(bool)
+ * Handle MMU notifier invalidations of KFD userptr BOs by unmapping only the
+ * affected BO and letting the GPU retry fault on it until it is restored,
+ * instead of stopping all queues of the process. Only used when all GPUs of
+ * the process have retry faults enabled and the process runs with XNACK on,
+ * otherwise the queues are still stopped.
+ */
+bool userptr_range_inval;
+module_param(userptr_range_inval, bool, 0444);
+MODULE_PARM_DESC(userptr_range_inval, "unmap only invalidated userptr BOs when XNACK is on (false = default)");
+
 /**
  * DOC: no_queue_eviction_on_vm_fault (int)
  * If set, process queues will not be evicted on gpuvm fault. This is to keep the wavefront context for debugging (0 = queue eviction, 1 = no queue eviction). The default is 0 (queue eviction).
@@ -2916,6 +3017,25 @@ static int amdgpu_flush(struct file *f, fl_owner_t id)
 	return timeout >= 0 ? 0 : timeout;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Place BO mappings PMD aligned when huge mmap faults are enabled, otherwise
+ * no PMD sized range of the VMA is ever aligned and every fault falls back.
+ * The alignment is relative to the start of the mapping, not the fake offset.
+ */
+static unsigned long amdgpu_get_unmapped_area(struct file *filp,
+					      unsigned long addr,
+					      unsigned long len,
+					      unsigned long pgoff,
+					      unsigned long flags)
+{
+	if (amdgpu_huge_mmap)
+		return thp_get_unmapped_area(filp, addr, len, 0, flags);
+
+	return mm_get_unmapped_area(current->mm, filp, addr, len, pgoff, flags);
+}
+#endif
+
 static const struct file_operations amdgpu_driver_kms_fops = {
 	.owner = THIS_MODULE,
 	.open = drm_open,
@@ -2923,6 +3043,9 @@ static const struct file_operations amdgpu_driver_kms_fops = {
 	.release = drm_release,
 	.unlocked_ioctl = amdgpu_drm_ioctl,
 	.mmap = drm_gem_mmap,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.get_unmapped_area = amdgpu_get_unmapped_area,
+#endif
 	.poll = drm_poll,
 	.read = drm_read,
 #ifdef CONFIG_COMPAT
@@ -257,6 +257,80 @@ static void amdgpu_fence_schedule_fallback(struct amdgpu_ring *ring)
 		  jiffies + AMDGPU_FENCE_JIFFIES_TIMEOUT);
 }
 
+/*
+ * Signal the fences in the slots after @last_seq up to and including @seq,
+ * account their latency since @stamp and drop the runtime PM references they
+ * hold in one go.
+ */
+static void amdgpu_fence_signal_range(struct amdgpu_ring *ring,
+				      uint32_t last_seq, uint32_t seq,
+				      ktime_t stamp)
+{
+	struct amdgpu_fence_driver *drv = &ring->fence_drv;
+	struct device *dev = adev_to_drm(ring->adev)->dev;
+	unsigned int count = 0;
+	u64 lat;
+
+	last_seq &= drv->num_fences_mask;
+	seq &= drv->num_fences_mask;
+
+	do {
+		struct dma_fence *fence, **ptr;
+
+		++last_seq;
+		last_seq &= drv->num_fences_mask;
+		ptr = &drv->fences[last_seq];
+
+		/* There is always exactly one thread signaling this fence slot */
+		fence = rcu_dereference_protected(*ptr, 1);
+		RCU_INIT_POINTER(*ptr, NULL);
+
+		if (!fence)
+			continue;
+
+		dma_fence_signal(fence);
+		dma_fence_put(fence);
+
+		lat = ktime_us_delta(ktime_get(), stamp);
+		atomic64_inc(&drv->signal_hist[min_t(u64, lat ? fls64(lat) : 0,
+						     AMDGPU_FENCE_SIGNAL_HIST - 1)]);
+		++count;
+	} while (last_seq != seq);
+
+	if (!count)
+		return;
+
+	/* Only the last reference needs to check for autosuspend */
+	while (--count)
+		pm_runtime_put_noidle(dev);
+	pm_runtime_mark_last_busy(dev);
+	pm_runtime_put_autosuspend(dev);
+}
+
+/**
+ * amdgpu_fence_signal_work - signal fences outside of interrupt context
+ *
+ * @work: the signal_work of the fence driver
+ *
+ * Signals all fences between the last sequence number handled by the worker
+ * and the one last seen by amdgpu_fence_process() as one batch.
+ */
+static void amdgpu_fence_signal_work(struct work_struct *work)
+{
+	struct amdgpu_fence_driver *drv =
+		container_of(work, struct amdgpu_fence_driver, signal_work);
+	struct amdgpu_ring *ring = container_of(drv, struct amdgpu_ring,
+						fence_drv);
+	ktime_t stamp = READ_ONCE(drv->signal_stamp);
+	uint32_t seq = atomic_read(&drv->last_seq);
+
+	if (seq == drv->signaled_seq)
+		return;
+
+	amdgpu_fence_signal_range(ring, drv->signaled_seq, seq, stamp);
+	drv->signaled_seq = seq;
+}
+
 /**
  * amdgpu_fence_process - check for fence activity
  *
@@ -264,14 +338,14 @@ static void amdgpu_fence_schedule_fallback(struct amdgpu_ring *ring)
  *
  * Checks the current fence value and calculates the last
  * signalled fence value. Wakes the fence queue if the
- * sequence number has increased.
+ * sequence number has increased. On rings using deferred
+ * signaling the fences are signaled by amdgpu_fence_signal_work().
  *
  * Returns true if fence was processed
  */
 bool amdgpu_fence_process(struct amdgpu_ring *ring)
 {
 	struct amdgpu_fence_driver *drv = &ring->fence_drv;
-	struct amdgpu_device *adev = ring->adev;
 	uint32_t seq, last_seq;
 
 	do {
@@ -287,30 +361,138 @@ bool amdgpu_fence_process(struct amdgpu_ring *ring)
 	if (unlikely(seq == last_seq))
 		return false;
 
-	last_seq &= drv->num_fences_mask;
-	seq &= drv->num_fences_mask;
+	if (drv->deferred_signal) {
+		/* Latency is measured from the oldest unhandled update */
+		if (!work_pending(&drv->signal_work))
+			WRITE_ONCE(drv->signal_stamp, ktime_get());
+		queue_work(system_highpri_wq, &drv->signal_work);
+		return true;
+	}
 
-	do {
-		struct dma_fence *fence, **ptr;
+	amdgpu_fence_signal_range(ring, last_seq, seq, ktime_get());
+	return true;
+}
 
-		++last_seq;
-		last_seq &= drv->num_fences_mask;
-		ptr = &drv->fences[last_seq];
+/*
+ * Make sure all fences processed so far are signaled, only needed for rings
+ * using deferred signaling.
+ */
+static void amdgpu_fence_flush_signal(struct amdgpu_ring *ring)
+{
+	if (ring->fence_drv.deferred_signal)
+		flush_work(&ring->fence_drv.signal_work);
+}
 
-		/* There is always exactly one thread signaling this fence slot */
-		fence = rcu_dereference_protected(*ptr, 1);
-		RCU_INIT_POINTER(*ptr, NULL);
+/*
+ * Find the ring and hardware sequence number a scheduler fence waits for.
+ * A reset can drop the hardware fence concurrently, so on success a
+ * reference to it is returned in @parent which the caller must put.
+ */
+static struct amdgpu_ring *amdgpu_fence_hw_ring(struct dma_fence *f,
+						uint32_t *seq,
+						struct dma_fence **parent)
+{
+	struct drm_sched_fence *s_fence = to_drm_sched_fence(f);
+	struct amdgpu_ring *ring = NULL;
+	struct dma_fence *hw_fence;
+	struct amdgpu_job *job;
 
-		if (!fence)
-			continue;
+	if (!s_fence || f != &s_fence->finished)
+		return NULL;
 
-		dma_fence_signal(fence);
-		dma_fence_put(fence);
-		pm_runtime_mark_last_busy(adev_to_drm(adev)->dev);
-		pm_runtime_put_autosuspend(adev_to_drm(adev)->dev);
-	} while (last_seq != seq);
+	/* The job isn't running yet, nothing to poll for */
+	rcu_read_lock();
+	hw_fence = dma_fence_get_rcu_safe((struct dma_fence __rcu **)
+					  &s_fence->parent);
+	rcu_read_unlock();
+	if (!hw_fence)
+		return NULL;
+
+	*seq = lower_32_bits(hw_fence->seqno);
+	if (hw_fence->ops == &amdgpu_job_fence_ops) {
+		job = container_of(hw_fence, struct amdgpu_job, hw_fence);
+		ring = to_amdgpu_ring(job->base.sched);
+	} else if (hw_fence->ops == &amdgpu_fence_ops) {
+		ring = to_amdgpu_fence(hw_fence)->ring;
+	}
 
-	return true;
+	if (!ring) {
+		dma_fence_put(hw_fence);
+		return NULL;
+	}
+
+	*parent = hw_fence;
+	return ring;
+}
+
+/**
+ * amdgpu_fence_wait_hybrid - wait for a fence, busy polling first
+ *
+ * @fence: the scheduler fence of a submission
+ * @intr: use interruptible sleep
+ * @timeout: timeout in jiffies for the sleeping wait
+ *
+ * When amdgpu_fence_poll_us is set and recent waits on the ring completed
+ * quickly enough, spin on the fence memory of the ring for a while before
+ * going to sleep and waiting for the interrupt. This avoids the interrupt
+ * and wakeup latency for short running jobs. Interruptible waits stop
+ * spinning when a signal is pending.
+ *
+ * Returns the same as dma_fence_wait_timeout().
+ */
+long amdgpu_fence_wait_hybrid(struct dma_fence *fence, bool intr,
+			      long timeout)
+{
+	u64 max_ns = (u64)min_t(uint, READ_ONCE(amdgpu_fence_poll_us),
+				AMDGPU_FENCE_POLL_MAX_US) * NSEC_PER_USEC;
+	struct amdgpu_fence_driver *drv;
+	struct dma_fence *parent;
+	struct amdgpu_ring *ring;
+	ktime_t start, deadline;
+	u64 avg, lat;
+	uint32_t seq;
+	long r;
+
+	if (!max_ns || dma_fence_is_signaled(fence))
+		return dma_fence_wait_timeout(fence, intr, timeout);
+
+	ring = amdgpu_fence_hw_ring(fence, &seq, &parent);
+	if (!ring)
+		return dma_fence_wait_timeout(fence, intr, timeout);
+
+	drv = &ring->fence_drv;
+	start = ktime_get();
+	avg = READ_ONCE(drv->wait_avg_ns);
+
+	/* Poll for twice the average wait time, everything else is too long */
+	if (avg <= max_ns) {
+		deadline = ktime_add_ns(start, avg ? min(2 * avg, max_ns) : max_ns);
+		atomic64_inc(&drv->poll_waits);
+		while ((int32_t)(amdgpu_fence_read(ring) - seq) < 0 &&
+		       ktime_before(ktime_get(), deadline) && !need_resched() &&
+		       !(intr && signal_pending(current)))
+			cpu_relax();
+
+		if ((int32_t)(amdgpu_fence_read(ring) - seq) >= 0) {
+			amdgpu_fence_process(ring);
+			amdgpu_fence_flush_signal(ring);
+			atomic64_inc(&drv->poll_hits);
+		}
+		atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+			     &drv->poll_ns);
+	}
+	dma_fence_put(parent);
+
+	if (intr && signal_pending(current))
+		return -ERESTARTSYS;
+
+	r = dma_fence_wait_timeout(fence, intr, timeout);
+	if (r > 0) {
+		lat = ktime_to_ns(ktime_sub(ktime_get(), start));
+		WRITE_ONCE(drv->wait_avg_ns, avg ? (avg * 7 + lat) / 8 : lat);
+	}
+
+	return r;
 }
 
 /**
@@ -519,6 +701,11 @@ int amdgpu_fence_driver_init_ring(struct amdgpu_ring *ring)
 	atomic_set(&ring->fence_drv.last_seq, 0);
 	ring->fence_drv.initialized = false;
 
+	ring->fence_drv.signaled_seq = 0;
+	ring->fence_drv.deferred_signal =
+		!!(amdgpu_fence_deferred_signal & BIT(ring->funcs->type));
+	INIT_WORK(&ring->fence_drv.signal_work, amdgpu_fence_signal_work);
+
 	timer_setup(&ring->fence_drv.fallback_timer, amdgpu_fence_fallback, 0);
 
 	ring->fence_drv.num_fences_mask = ring->num_hw_submission * 2 - 1;
@@ -633,9 +820,10 @@ void amdgpu_fence_driver_isr_toggle(struct amdgpu_device *adev, bool stop)
 		if (!ring || !ring->fence_drv.initialized || !ring->fence_drv.irq_src)
 			continue;
 
-		if (stop)
+		if (stop) {
 			disable_irq(adev->irq.irq);
-		else
+			amdgpu_fence_flush_signal(ring);
+		} else
 			enable_irq(adev->irq.irq);
 	}
 }
@@ -659,6 +847,7 @@ void amdgpu_fence_driver_sw_fini(struct amdgpu_device *adev)
 		if (ring->sched.ops)
 			drm_sched_fini(&ring->sched);
 
+		cancel_work_sync(&ring->fence_drv.signal_work);
 		for (j = 0; j <= ring->fence_drv.num_fences_mask; ++j)
 			dma_fence_put(ring->fence_drv.fences[j]);
 		kfree(ring->fence_drv.fences);
@@ -762,6 +951,7 @@ void amdgpu_fence_driver_force_completion(struct amdgpu_ring *ring)
 	amdgpu_fence_driver_set_error(ring, -ECANCELED);
 	amdgpu_fence_write(ring, ring->fence_drv.sync_seq);
 	amdgpu_fence_process(ring);
+	amdgpu_fence_flush_signal(ring);
 }
 
 /*
@@ -895,7 +1085,7 @@ static const struct dma_fence_ops amdgpu_job_fence_ops = {
 static int amdgpu_debugfs_fence_info_show(struct seq_file *m, void *unused)
 {
 	struct amdgpu_device *adev = m->private;
-	int i;
+	int i, j;
 
 	for (i = 0; i < AMDGPU_MAX_RINGS; ++i) {
 		struct amdgpu_ring *ring = adev->rings[i];
@@ -911,6 +1101,28 @@ static int amdgpu_debugfs_fence_info_show(struct seq_file *m, void *unused)
 		seq_printf(m, "Last emitted                 0x%08x\n",
 			   ring->fence_drv.sync_seq);
 
+		if (atomic64_read(&ring->fence_drv.poll_waits)) {
+			seq_printf(m, "Polled waits                 %lld\n",
+				   atomic64_read(&ring->fence_drv.poll_waits));
+			seq_printf(m, "Poll hits                    %lld\n",
+				   atomic64_read(&ring->fence_drv.poll_hits));
+			seq_printf(m, "Poll time                    %llu us\n",
+				   div_u64(atomic64_read(&ring->fence_drv.poll_ns),
+					   NSEC_PER_USEC));
+			seq_printf(m, "Average wait                 %llu us\n",
+				   div_u64(READ_ONCE(ring->fence_drv.wait_avg_ns),
+					   NSEC_PER_USEC));
+		}
+
+		seq_printf(m, "Signal latency (us)         ");
+		for (j = 0; j < AMDGPU_FENCE_SIGNAL_HIST - 1; ++j)
+			seq_printf(m, " <%u:%lld", 1u << j,
+				   atomic64_read(&ring->fence_drv.signal_hist[j]));
+		seq_printf(m, " >=%u:%lld", 1u << (j - 1),
+			   atomic64_read(&ring->fence_drv.signal_hist[j]));
+		seq_printf(m, "%s\n", ring->fence_drv.deferred_signal ?
+			   " (deferred)" : "");
+
 		if (ring->funcs->type == AMDGPU_RING_TYPE_GFX ||
 		    ring->funcs->type == AMDGPU_RING_TYPE_SDMA) {
 			seq_printf(m, "Last signaled trailing fence 0x%08x\n",
@@ -41,6 +41,7 @@
 #include "amdgpu_display.h"
 #include "amdgpu_dma_buf.h"
 #include "amdgpu_hmm.h"
+#include "amdgpu_res_cursor.h"
 #include "amdgpu_xgmi.h"
 
 static const struct drm_gem_object_funcs amdgpu_gem_object_funcs;
@@ -49,6 +50,8 @@ static vm_fault_t amdgpu_gem_fault(struct vm_fault *vmf)
 {
 	struct ttm_buffer_object *bo = vmf->vma->vm_private_data;
 	struct drm_device *ddev = bo->base.dev;
+	pgoff_t num_prefault = TTM_BO_VM_NUM_PREFAULT;
+	pgoff_t page_offset;
 	vm_fault_t ret;
 	int idx;
 
@@ -57,14 +60,18 @@ static vm_fault_t amdgpu_gem_fault(struct vm_fault *vmf)
 		return ret;
 
 	if (drm_dev_enter(ddev, &idx)) {
-		ret = amdgpu_bo_fault_reserve_notify(bo);
+		page_offset = ((vmf->address - vmf->vma->vm_start) >> PAGE_SHIFT) +
+			vmf->vma->vm_pgoff - drm_vma_node_start(&bo->base.vma_node);
+
+		ret = amdgpu_bo_fault_reserve_notify(bo, page_offset,
+						     &num_prefault);
 		if (ret) {
 			drm_dev_exit(idx);
 			goto unlock;
 		}
 
 		ret = ttm_bo_vm_fault_reserved(vmf, vmf->vma->vm_page_prot,
-					       TTM_BO_VM_NUM_PREFAULT);
+					       num_prefault);
 
 		drm_dev_exit(idx);
 	} else {
@@ -78,8 +85,118 @@ unlock:
 	return ret;
 }
 
+#if defined(CONFIG_ARCH_SUPPORTS_PMD_PFNMAP) || defined(CONFIG_ARCH_SUPPORTS_PUD_PFNMAP)
+/*
+ * Map a whole PMD or PUD sized range of a BO in CPU visible VRAM with a
+ * single entry. Anything which doesn't line up falls back to
+ * amdgpu_gem_fault() mapping single pages.
+ *
+ * The vma protection isn't adjusted to the caching of the placement like
+ * ttm_bo_vm_fault_reserved() does for single pages, the entries get their
+ * caching from the PAT memtype of the aperture instead. So this is x86 only.
+ */
+static vm_fault_t amdgpu_gem_huge_fault(struct vm_fault *vmf,
+					unsigned int order)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	struct ttm_buffer_object *bo = vma->vm_private_data;
+	struct amdgpu_device *adev = amdgpu_ttm_adev(bo->bdev);
+	pgoff_t page_offset, num_pages = 1UL << order;
+	u64 size = (u64)PAGE_SIZE << order;
+	struct amdgpu_res_cursor cursor;
+	vm_fault_t ret;
+	unsigned long addr, pfn;
+	int idx;
+
+	if (!order)
+		return amdgpu_gem_fault(vmf);
+
+	if (!IS_ENABLED(CONFIG_X86) || !amdgpu_huge_mmap ||
+	    (order != PMD_ORDER && amdgpu_huge_mmap < 2))
+		return VM_FAULT_FALLBACK;
+
+	/* The core hands in the faulting address, not the start of the entry */
+	addr = ALIGN_DOWN(vmf->address, size);
+	if (addr < vma->vm_start || addr + size > vma->vm_end)
+		return VM_FAULT_FALLBACK;
+
+	ret = ttm_bo_vm_reserve(bo, vmf);
+	if (ret)
+		return ret;
+
+	if (!drm_dev_enter(bo->base.dev, &idx)) {
+		ret = VM_FAULT_FALLBACK;
+		goto unlock;
+	}
+
+	page_offset = ((addr - vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff -
+		drm_vma_node_start(&bo->base.vma_node);
+	if (((u64)page_offset << PAGE_SHIFT) + size > bo->base.size) {
+		ret = VM_FAULT_FALLBACK;
+		goto exit;
+	}
+
+	ret = amdgpu_bo_fault_reserve_notify(bo, page_offset, &num_pages);
+	if (ret)
+		goto exit;
+
+	/* Only part of the range is visible or a move is still in flight */
+	ret = VM_FAULT_FALLBACK;
+	if (num_pages != 1UL << order ||
+	    bo->resource->mem_type != TTM_PL_VRAM ||
+	    !dma_resv_test_signaled(bo->base.resv, DMA_RESV_USAGE_KERNEL))
+		goto exit;
+
+	amdgpu_res_first(bo->resource, (u64)page_offset << PAGE_SHIFT, size,
+			 &cursor);
+	if (cursor.size < size ||
+	    cursor.start + size > adev->gmc.visible_vram_size)
+		goto exit;
+
+	pfn = (adev->gmc.aper_base + cursor.start) >> PAGE_SHIFT;
+	if (pfn & (num_pages - 1))
+		goto exit;
+
+	switch (order) {
+#ifdef CONFIG_ARCH_SUPPORTS_PMD_PFNMAP
+	case PMD_ORDER:
+		ret = vmf_insert_pfn_pmd(vmf, __pfn_to_pfn_t(pfn, PFN_DEV),
+					 vmf->flags & FAULT_FLAG_WRITE);
+		if (ret == VM_FAULT_NOPAGE)
+			atomic64_inc(&adev->num_huge_faults_pmd);
+		break;
+#endif
+#ifdef CONFIG_ARCH_SUPPORTS_PUD_PFNMAP
+	case PUD_ORDER:
+		ret = vmf_insert_pfn_pud(vmf, __pfn_to_pfn_t(pfn, PFN_DEV),
+					 vmf->flags & FAULT_FLAG_WRITE);
+		if (ret == VM_FAULT_NOPAGE)
+			atomic64_inc(&adev->num_huge_faults_pud);
+		break;
+#endif
+	default:
+		break;
+	}
+
+exit:
+	drm_dev_exit(idx);
+unlock:
+	/*
+	 * The core tries PUD before PMD, only count faults which end up with
+	 * single pages so a successful PMD after a PUD attempt isn't a miss.
+	 */
+	if (ret == VM_FAULT_FALLBACK && order == PMD_ORDER)
+		atomic64_inc(&adev->num_huge_faults_fallback);
+	dma_resv_unlock(bo->base.resv);
+	return ret;
+}
+#endif
+
 static const struct vm_operations_struct amdgpu_gem_vm_ops = {
 	.fault = amdgpu_gem_fault,
+#if defined(CONFIG_ARCH_SUPPORTS_PMD_PFNMAP) || defined(CONFIG_ARCH_SUPPORTS_PUD_PFNMAP)
+	.huge_fault = amdgpu_gem_huge_fault,
+#endif
 	.open = ttm_bo_vm_open,
 	.close = ttm_bo_vm_close,
 	.access = ttm_bo_vm_access
@@ -1031,6 +1148,23 @@ static int amdgpu_debugfs_gem_info_show(struct seq_file *m, void *unused)
 
 DEFINE_SHOW_ATTRIBUTE(amdgpu_debugfs_gem_info);
 
+static int amdgpu_debugfs_gem_mmap_info_show(struct seq_file *m, void *unused)
+{
+	struct amdgpu_device *adev = m->private;
+	u64 pmd = atomic64_read(&adev->num_huge_faults_pmd);
+	u64 pud = atomic64_read(&adev->num_huge_faults_pud);
+	u64 fallback = atomic64_read(&adev->num_huge_faults_fallback);
+	u64 total = pmd + pud + fallback;
+
+	seq_printf(m, "huge faults pmd: %llu pud: %llu fallback: %llu\n",
+		   pmd, pud, fallback);
+	seq_printf(m, "huge mapping hit rate: %llu%%\n",
+		   total ? div64_u64((pmd + pud) * 100, total) : 0);
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(amdgpu_debugfs_gem_mmap_info);
+
 #endif
 
 void amdgpu_debugfs_gem_init(struct amdgpu_device *adev)
@@ -1041,5 +1175,7 @@ void amdgpu_debugfs_gem_init(struct amdgpu_device *adev)
 
 	debugfs_create_file("amdgpu_gem_info", 0444, root, adev,
 			    &amdgpu_debugfs_gem_info_fops);
+	debugfs_create_file("amdgpu_gem_mmap_info", 0444, root, adev,
+			    &amdgpu_debugfs_gem_mmap_info_fops);
 #endif
 }
@@ -1012,13 +1012,53 @@ void amdgpu_gfx_ras_error_func(struct amdgpu_device *adev,
 		func(adev, ras_error_status, i);
 }
 
-uint32_t amdgpu_kiq_rreg(struct amdgpu_device *adev, uint32_t reg, uint32_t xcc_id)
+static bool amdgpu_kiq_reg_wait(struct amdgpu_device *adev,
+				struct amdgpu_kiq *kiq, uint32_t seq,
+				uint32_t count, ktime_t start)
 {
+	struct amdgpu_ring *ring = &kiq->ring;
 	signed long r, cnt = 0;
+
+	r = amdgpu_fence_wait_polling(ring, seq, MAX_KIQ_REG_WAIT);
+
+	/* don't wait anymore for gpu reset case because this way may
+	 * block gpu_recover() routine forever, e.g. this virt_kiq_rreg
+	 * is triggered in TTM and ttm_bo_lock_delayed_workqueue() will
+	 * never return if we keep waiting in virt_kiq_rreg, which cause
+	 * gpu_recover() hang there.
+	 *
+	 * also don't wait anymore for IRQ context
+	 * */
+	if (r < 1 && (amdgpu_in_reset(adev) || in_interrupt()))
+		goto failed;
+
+	might_sleep();
+	while (r < 1 && cnt++ < MAX_KIQ_REG_TRY) {
+		msleep(MAX_KIQ_REG_BAILOUT_INTERVAL);
+		r = amdgpu_fence_wait_polling(ring, seq, MAX_KIQ_REG_WAIT);
+	}
+
+	if (cnt > MAX_KIQ_REG_TRY)
+		goto failed;
+
+	atomic64_inc(&kiq->stats.submissions);
+	atomic64_add(count, &kiq->stats.regs);
+	atomic64_add(ktime_us_delta(ktime_get(), start), &kiq->stats.wait_us);
+	return true;
+
+failed:
+	atomic64_inc(&kiq->stats.timeouts);
+	return false;
+}
+
+uint32_t amdgpu_kiq_rreg(struct amdgpu_device *adev, uint32_t reg, uint32_t xcc_id)
+{
+	signed long r;
 	unsigned long flags;
 	uint32_t seq, reg_val_offs = 0, value = 0;
 	struct amdgpu_kiq *kiq = &adev->gfx.kiq[xcc_id];
 	struct amdgpu_ring *ring = &kiq->ring;
+	ktime_t start;
 
 	if (amdgpu_device_skip_hw_access(adev))
 		return 0;
@@ -1037,6 +1077,7 @@ uint32_t amdgpu_kiq_rreg(struct amdgpu_device *adev, uint32_t reg, uint32_t xcc_
 	if (r)
 		goto failed_unlock;
 
+	start = ktime_get();
 	amdgpu_ring_emit_rreg(ring, reg, reg_val_offs);
 	r = amdgpu_fence_emit_polling(ring, &seq, MAX_KIQ_REG_WAIT);
 	if (r)
@@ -1045,26 +1086,7 @@ uint32_t amdgpu_kiq_rreg(struct amdgpu_device *adev, uint32_t reg, uint32_t xcc_
 	amdgpu_ring_commit(ring);
 	spin_unlock_irqrestore(&kiq->ring_lock, flags);
 
-	r = amdgpu_fence_wait_polling(ring, seq, MAX_KIQ_REG_WAIT);
-
-	/* don't wait anymore for gpu reset case because this way may
-	 * block gpu_recover() routine forever, e.g. this virt_kiq_rreg
-	 * is triggered in TTM and ttm_bo_lock_delayed_workqueue() will
-	 * never return if we keep waiting in virt_kiq_rreg, which cause
-	 * gpu_recover() hang there.
-	 *
-	 * also don't wait anymore for IRQ context
-	 * */
-	if (r < 1 && (amdgpu_in_reset(adev) || in_interrupt()))
-		goto failed_kiq_read;
-
-	might_sleep();
-	while (r < 1 && cnt++ < MAX_KIQ_REG_TRY) {
-		msleep(MAX_KIQ_REG_BAILOUT_INTERVAL);
-		r = amdgpu_fence_wait_polling(ring, seq, MAX_KIQ_REG_WAIT);
-	}
-
-	if (cnt > MAX_KIQ_REG_TRY)
+	if (!amdgpu_kiq_reg_wait(adev, kiq, seq, 1, start))
 		goto failed_kiq_read;
 
 	mb();
@@ -1085,11 +1107,12 @@ failed_kiq_read:
 
 void amdgpu_kiq_wreg(struct amdgpu_device *adev, uint32_t reg, uint32_t v, uint32_t xcc_id)
 {
-	signed long r, cnt = 0;
+	signed long r;
 	unsigned long flags;
 	uint32_t seq;
 	struct amdgpu_kiq *kiq = &adev->gfx.kiq[xcc_id];
 	struct amdgpu_ring *ring = &kiq->ring;
+	ktime_t start;
 
 	BUG_ON(!ring->funcs->emit_wreg);
 
@@ -1106,6 +1129,7 @@ void amdgpu_kiq_wreg(struct amdgpu_device *adev, uint32_t reg, uint32_t v, uint3
 	if (r)
 		goto failed_unlock;
 
+	start = ktime_get();
 	amdgpu_ring_emit_wreg(ring, reg, v);
 	r = amdgpu_fence_emit_polling(ring, &seq, MAX_KIQ_REG_WAIT);
 	if (r)
@@ -1114,37 +1138,106 @@ void amdgpu_kiq_wreg(struct amdgpu_device *adev, uint32_t reg, uint32_t v, uint3
 	amdgpu_ring_commit(ring);
 	spin_unlock_irqrestore(&kiq->ring_lock, flags);
 
-	r = amdgpu_fence_wait_polling(ring, seq, MAX_KIQ_REG_WAIT);
-
-	/* don't wait anymore for gpu reset case because this way may
-	 * block gpu_recover() routine forever, e.g. this virt_kiq_rreg
-	 * is triggered in TTM and ttm_bo_lock_delayed_workqueue() will
-	 * never return if we keep waiting in virt_kiq_rreg, which cause
-	 * gpu_recover() hang there.
-	 *
-	 * also don't wait anymore for IRQ context
-	 * */
-	if (r < 1 && (amdgpu_in_reset(adev) || in_interrupt()))
+	if (!amdgpu_kiq_reg_wait(adev, kiq, seq, 1, start))
 		goto failed_kiq_write;
 
-	might_sleep();
-	while (r < 1 && cnt++ < MAX_KIQ_REG_TRY) {
+	return;
 
-		msleep(MAX_KIQ_REG_BAILOUT_INTERVAL);
-		r = amdgpu_fence_wait_polling(ring, seq, MAX_KIQ_REG_WAIT);
+failed_undo:
+	amdgpu_ring_undo(ring);
+failed_unlock:
+	spin_unlock_irqrestore(&kiq->ring_lock, flags);
+failed_kiq_write:
+	dev_err(adev->dev, "failed to write reg:%x\n", reg);
+}
+
+/**
+ * amdgpu_kiq_rreg_batch - read a list of registers through the KIQ
+ *
+ * @adev: amdgpu_device pointer
+ * @regs: dword aligned register offsets
+ * @vals: the register values read, may alias @regs
+ * @count: number of registers
+ * @xcc_id: xcc accelerated compute core id
+ *
+ * Same as amdgpu_kiq_rreg() but emits up to AMDGPU_KIQ_REG_BATCH reads into
+ * one writeback slot and only waits for a single fence per batch.
+ * Returns 0 on success, on failure the remaining values read as ~0.
+ */
+int amdgpu_kiq_rreg_batch(struct amdgpu_device *adev, const uint32_t *regs,
+			  uint32_t *vals, uint32_t count, uint32_t xcc_id)
+{
+	struct amdgpu_kiq *kiq = &adev->gfx.kiq[xcc_id];
+	struct amdgpu_ring *ring = &kiq->ring;
+	uint32_t seq, reg_val_offs, i, n;
+	unsigned long flags;
+	ktime_t start;
+	int r;
+
+	if (!count)
+		return 0;
+
+	if (amdgpu_device_skip_hw_access(adev)) {
+		memset(vals, 0, count * sizeof(*vals));
+		return 0;
 	}
 
-	if (cnt > MAX_KIQ_REG_TRY)
-		goto failed_kiq_write;
+	if (adev->mes.ring[0].sched.ready) {
+		for (i = 0; i < count; i++)
+			vals[i] = amdgpu_mes_rreg(adev, regs[i]);
+		return 0;
+	}
 
-	return;
+	BUG_ON(!ring->funcs->emit_rreg);
+
+	if (amdgpu_device_wb_get(adev, &reg_val_offs)) {
+		pr_err("critical bug! too many kiq readers\n");
+		r = -EINVAL;
+		goto failed;
+	}
+
+	for (; count; count -= n, regs += n, vals += n) {
+		n = min_t(uint32_t, count, AMDGPU_KIQ_REG_BATCH);
+
+		spin_lock_irqsave(&kiq->ring_lock, flags);
+		r = amdgpu_ring_alloc(ring, 32 + n * 8);
+		if (r)
+			goto failed_unlock;
+
+		start = ktime_get();
+		for (i = 0; i < n; i++)
+			amdgpu_ring_emit_rreg(ring, regs[i], reg_val_offs + i);
+		r = amdgpu_fence_emit_polling(ring, &seq, MAX_KIQ_REG_WAIT);
+		if (r)
+			goto failed_undo;
+
+		amdgpu_ring_commit(ring);
+		spin_unlock_irqrestore(&kiq->ring_lock, flags);
+
+		if (!amdgpu_kiq_reg_wait(adev, kiq, seq, n, start)) {
+			r = -ETIMEDOUT;
+			goto failed_free;
+		}
+
+		mb();
+		for (i = 0; i < n; i++)
+			vals[i] = adev->wb.wb[reg_val_offs + i];
+	}
+
+	amdgpu_device_wb_free(adev, reg_val_offs);
+	return 0;
 
 failed_undo:
 	amdgpu_ring_undo(ring);
 failed_unlock:
 	spin_unlock_irqrestore(&kiq->ring_lock, flags);
-failed_kiq_write:
-	dev_err(adev->dev, "failed to write reg:%x\n", reg);
+failed_free:
+	amdgpu_device_wb_free(adev, reg_val_offs);
+failed:
+	dev_err(adev->dev, "failed to read %u regs starting at reg:%x\n",
+		count, regs[0]);
+	memset(vals, 0xff, count * sizeof(*vals));
+	return r;
 }
 
 int amdgpu_gfx_get_num_kcq(struct amdgpu_device *adev)
@@ -1543,15 +1636,12 @@ static ssize_t amdgpu_gfx_get_enforce_isolation(struct device *dev,
 	return size;
 }
 
-static ssize_t amdgpu_gfx_set_enforce_isolation(struct device *dev,
-						struct device_attribute *attr,
-						const char *buf, size_t count)
+/* Parse one space separated value per partition */
+static int amdgpu_gfx_parse_partition_values(struct amdgpu_device *adev,
+					     const char *input_buf,
+					     long *partition_values)
 {
-	struct drm_device *ddev = dev_get_drvdata(dev);
-	struct amdgpu_device *adev = drm_to_adev(ddev);
-	long partition_values[MAX_XCP] = {0};
 	int ret, i, num_partitions;
-	const char *input_buf = buf;
 
 	for (i = 0; i < (adev->xcp_mgr ? adev->xcp_mgr->num_xcps : 1); i++) {
 		ret = sscanf(input_buf, "%ld", &partition_values[i]);
@@ -1575,6 +1665,23 @@ static ssize_t amdgpu_gfx_set_enforce_isolation(struct device *dev,
 	if (!adev->xcp_mgr && num_partitions != 1)
 		return -EINVAL;
 
+	return num_partitions;
+}
+
+static ssize_t amdgpu_gfx_set_enforce_isolation(struct device *dev,
+						struct device_attribute *attr,
+						const char *buf, size_t count)
+{
+	struct drm_device *ddev = dev_get_drvdata(dev);
+	struct amdgpu_device *adev = drm_to_adev(ddev);
+	long partition_values[MAX_XCP] = {0};
+	int i, num_partitions;
+
+	num_partitions = amdgpu_gfx_parse_partition_values(adev, buf,
+							   partition_values);
+	if (num_partitions < 0)
+		return num_partitions;
+
 	for (i = 0; i < num_partitions; i++) {
 		if (partition_values[i] != 0 && partition_values[i] != 1)
 			return -EINVAL;
@@ -1589,6 +1696,7 @@ static ssize_t amdgpu_gfx_set_enforce_isolation(struct device *dev,
 		} else if (!adev->enforce_isolation[i] && partition_values[i]) {
 			/* Going from disabled to enabled */
 			amdgpu_vmid_alloc_reserved(adev, AMDGPU_GFXHUB(i));
+			atomic_set(&adev->gfx.enforce_isolation[i].cleaner_owner, 0);
 		}
 		adev->enforce_isolation[i] = partition_values[i];
 	}
@@ -1598,13 +1706,147 @@ static ssize_t amdgpu_gfx_set_enforce_isolation(struct device *dev,
 	return count;
 }
 
+/*
+ * Per partition share of GFX_SLICE_PERIOD in percent for which the KGD keeps
+ * the GFX after its last submission before the KFD runqueue is resumed.
+ */
+static ssize_t amdgpu_gfx_get_enforce_isolation_weight(struct device *dev,
+						       struct device_attribute *attr,
+						       char *buf)
+{
+	struct drm_device *ddev = dev_get_drvdata(dev);
+	struct amdgpu_device *adev = drm_to_adev(ddev);
+	int i, num_xcps = adev->xcp_mgr ? adev->xcp_mgr->num_xcps : 1;
+	ssize_t size = 0;
+
+	for (i = 0; i < num_xcps; i++)
+		size += sysfs_emit_at(buf, size, "%u%c",
+				      adev->gfx.enforce_isolation[i].weight,
+				      i < num_xcps - 1 ? ' ' : '\n');
+
+	return size;
+}
+
+static ssize_t amdgpu_gfx_set_enforce_isolation_weight(struct device *dev,
+						       struct device_attribute *attr,
+						       const char *buf, size_t count)
+{
+	struct drm_device *ddev = dev_get_drvdata(dev);
+	struct amdgpu_device *adev = drm_to_adev(ddev);
+	long partition_values[MAX_XCP] = {0};
+	int i, num_partitions;
+
+	num_partitions = amdgpu_gfx_parse_partition_values(adev, buf,
+							   partition_values);
+	if (num_partitions < 0)
+		return num_partitions;
+
+	for (i = 0; i < num_partitions; i++) {
+		if (partition_values[i] < 1 || partition_values[i] > 100)
+			return -EINVAL;
+	}
+
+	mutex_lock(&adev->enforce_isolation_mutex);
+	for (i = 0; i < num_partitions; i++)
+		adev->gfx.enforce_isolation[i].weight = partition_values[i];
+	mutex_unlock(&adev->enforce_isolation_mutex);
+
+	return count;
+}
+
+/*
+ * One line per partition: time in ms spent with the GFX owned by the KGD and
+ * by the KFD, number of switches, the number of isolation checks which found
+ * KGD work still pending out of all checks, and how often the cleaner shader
+ * was run and skipped.
+ */
+static ssize_t amdgpu_gfx_get_enforce_isolation_stats(struct device *dev,
+						      struct device_attribute *attr,
+						      char *buf)
+{
+	struct drm_device *ddev = dev_get_drvdata(dev);
+	struct amdgpu_device *adev = drm_to_adev(ddev);
+	int i, num_xcps = adev->xcp_mgr ? adev->xcp_mgr->num_xcps : 1;
+	ssize_t size = 0;
+
+	mutex_lock(&adev->enforce_isolation_mutex);
+	for (i = 0; i < num_xcps; i++) {
+		struct amdgpu_isolation_work *iso = &adev->gfx.enforce_isolation[i];
+		u64 kgd_ns = iso->kgd_ns, kfd_ns = iso->kfd_ns;
+		u64 now = ktime_to_ns(ktime_sub(ktime_get(), iso->mode_start));
+
+		if (adev->gfx.kfd_sch_inactive[i])
+			kgd_ns += now;
+		else
+			kfd_ns += now;
+
+		size += sysfs_emit_at(buf, size,
+				      "%llu %llu %llu %llu %llu %lld %lld\n",
+				      div_u64(kgd_ns, NSEC_PER_MSEC),
+				      div_u64(kfd_ns, NSEC_PER_MSEC),
+				      iso->switches, iso->busy_checks,
+				      iso->checks,
+				      atomic64_read(&iso->cleaner_runs),
+				      atomic64_read(&iso->cleaner_elisions));
+	}
+	mutex_unlock(&adev->enforce_isolation_mutex);
+
+	return size;
+}
+
+/*
+ * 0: run the cleaner shader before every job with isolation enforced.
+ * 1: skip it while consecutive jobs on a partition come from the same PASID.
+ */
+static ssize_t amdgpu_gfx_get_cleaner_shader_policy(struct device *dev,
+						    struct device_attribute *attr,
+						    char *buf)
+{
+	struct drm_device *ddev = dev_get_drvdata(dev);
+	struct amdgpu_device *adev = drm_to_adev(ddev);
+
+	return sysfs_emit(buf, "%u\n", adev->gfx.cleaner_shader_policy);
+}
+
+static ssize_t amdgpu_gfx_set_cleaner_shader_policy(struct device *dev,
+						    struct device_attribute *attr,
+						    const char *buf, size_t count)
+{
+	struct drm_device *ddev = dev_get_drvdata(dev);
+	struct amdgpu_device *adev = drm_to_adev(ddev);
+	u32 value;
+	int ret;
+
+	ret = kstrtou32(buf, 0, &value);
+	if (ret)
+		return -EINVAL;
+
+	if (value != AMDGPU_CLEANER_SHADER_ALWAYS &&
+	    value != AMDGPU_CLEANER_SHADER_OWNER_CHANGE)
+		return -EINVAL;
+
+	WRITE_ONCE(adev->gfx.cleaner_shader_policy, value);
+	return count;
+}
+
 static DEVICE_ATTR(run_cleaner_shader, 0200,
 		   NULL, amdgpu_gfx_set_run_cleaner_shader);
 
+static DEVICE_ATTR(cleaner_shader_policy, 0644,
+		   amdgpu_gfx_get_cleaner_shader_policy,
+		   amdgpu_gfx_set_cleaner_shader_policy);
+
 static DEVICE_ATTR(enforce_isolation, 0644,
 		   amdgpu_gfx_get_enforce_isolation,
 		   amdgpu_gfx_set_enforce_isolation);
 
+static DEVICE_ATTR(enforce_isolation_weight, 0644,
+		   amdgpu_gfx_get_enforce_isolation_weight,
+		   amdgpu_gfx_set_enforce_isolation_weight);
+
+static DEVICE_ATTR(enforce_isolation_stats, 0444,
+		   amdgpu_gfx_get_enforce_isolation_stats, NULL);
+
 static DEVICE_ATTR(current_compute_partition, 0644,
 		   amdgpu_gfx_get_current_compute_partition,
 		   amdgpu_gfx_set_compute_partition);
@@ -1639,20 +1881,38 @@ int amdgpu_gfx_sysfs_isolation_shader_init(struct amdgpu_device *adev)
 		r = device_create_file(adev->dev, &dev_attr_enforce_isolation);
 		if (r)
 			return r;
+
+		r = device_create_file(adev->dev,
+				       &dev_attr_enforce_isolation_weight);
+		if (r)
+			return r;
+
+		r = device_create_file(adev->dev,
+				       &dev_attr_enforce_isolation_stats);
+		if (r)
+			return r;
 	}
 
 	r = device_create_file(adev->dev, &dev_attr_run_cleaner_shader);
 	if (r)
 		return r;
 
+	r = device_create_file(adev->dev, &dev_attr_cleaner_shader_policy);
+	if (r)
+		return r;
+
 	return 0;
 }
 
 void amdgpu_gfx_sysfs_isolation_shader_fini(struct amdgpu_device *adev)
 {
-	if (!amdgpu_sriov_vf(adev))
+	if (!amdgpu_sriov_vf(adev)) {
 		device_remove_file(adev->dev, &dev_attr_enforce_isolation);
+		device_remove_file(adev->dev, &dev_attr_enforce_isolation_weight);
+		device_remove_file(adev->dev, &dev_attr_enforce_isolation_stats);
+	}
 	device_remove_file(adev->dev, &dev_attr_run_cleaner_shader);
+	device_remove_file(adev->dev, &dev_attr_cleaner_shader_policy);
 }
 
 int amdgpu_gfx_cleaner_shader_sw_init(struct amdgpu_device *adev,
@@ -1690,6 +1950,33 @@ void amdgpu_gfx_cleaner_shader_init(struct amdgpu_device *adev,
 			    cleaner_shader_size);
 }
 
+/*
+ * Account the time spent in the current isolation mode when the GFX switches
+ * between the KGD and the KFD.
+ */
+static void amdgpu_gfx_isolation_switch(struct amdgpu_device *adev, u32 idx,
+					bool to_kgd)
+{
+	struct amdgpu_isolation_work *iso = &adev->gfx.enforce_isolation[idx];
+	ktime_t now = ktime_get();
+	u64 delta = ktime_to_ns(ktime_sub(now, iso->mode_start));
+
+	if (to_kgd)
+		iso->kfd_ns += delta;
+	else
+		iso->kgd_ns += delta;
+	iso->mode_start = now;
+	iso->switches++;
+}
+
+/* How long the KGD keeps the GFX after its last submission */
+static unsigned long amdgpu_gfx_isolation_slice(struct amdgpu_device *adev,
+						u32 idx)
+{
+	return max(1UL, GFX_SLICE_PERIOD *
+		   adev->gfx.enforce_isolation[idx].weight / 100);
+}
+
 /**
  * amdgpu_gfx_kfd_sch_ctrl - Control the KFD scheduler from the KGD (Graphics Driver)
  * @adev: amdgpu_device pointer
@@ -1704,7 +1991,8 @@ void amdgpu_gfx_cleaner_shader_init(struct amdgpu_device *adev,
  * track of the number of requests to enable the KFD scheduler. When a request
  * to enable the KFD scheduler is made, the reference count is decremented.
  * When the reference count reaches zero, a delayed work is scheduled to
- * enforce isolation after a delay of GFX_SLICE_PERIOD.
+ * enforce isolation after the weighted share of GFX_SLICE_PERIOD configured
+ * for the partition.
  *
  * When a request to disable the KFD scheduler is made, the function first
  * checks if the reference count is zero. If it is, it cancels the delayed work
@@ -1740,7 +2028,7 @@ static void amdgpu_gfx_kfd_sch_ctrl(struct amdgpu_device *adev, u32 idx,
 		if (adev->gfx.kfd_sch_req_count[idx] == 0 &&
 		    adev->gfx.kfd_sch_inactive[idx]) {
 			schedule_delayed_work(&adev->gfx.enforce_isolation[idx].work,
-					      GFX_SLICE_PERIOD);
+					      amdgpu_gfx_isolation_slice(adev, idx));
 		}
 	} else {
 		if (adev->gfx.kfd_sch_req_count[idx] == 0) {
@@ -1748,6 +2036,7 @@ static void amdgpu_gfx_kfd_sch_ctrl(struct amdgpu_device *adev, u32 idx,
 			if (!adev->gfx.kfd_sch_inactive[idx]) {
 				amdgpu_amdkfd_stop_sched(adev, idx);
 				adev->gfx.kfd_sch_inactive[idx] = true;
+				amdgpu_gfx_isolation_switch(adev, idx, true);
 			}
 		}
 
@@ -1765,10 +2054,10 @@ unlock:
  *
  * This function is the work handler for enforcing shader isolation on AMD GPUs.
  * It counts the number of emitted fences for each GFX and compute ring. If there
- * are any fences, it schedules the `enforce_isolation_work` to be run after a
- * delay of `GFX_SLICE_PERIOD`. If there are no fences, it signals the Kernel Fusion
- * Driver (KFD) to resume the runqueue. The function is synchronized using the
- * `enforce_isolation_mutex`.
+ * are any fences, it checks again after `GFX_SLICE_POLL_PERIOD` so that the KFD
+ * runqueue is resumed soon after the KGD work drained. If there are no fences,
+ * it signals the Kernel Fusion Driver (KFD) to resume the runqueue. The function
+ * is synchronized using the `enforce_isolation_mutex`.
  */
 void amdgpu_gfx_enforce_isolation_handler(struct work_struct *work)
 {
@@ -1794,9 +2083,12 @@ void amdgpu_gfx_enforce_isolation_handler(struct work_struct *work)
 		if (isolation_work->xcp_id == adev->gfx.compute_ring[i].xcp_id)
 			fences += amdgpu_fence_count_emitted(&adev->gfx.compute_ring[i]);
 	}
+	isolation_work->checks++;
 	if (fences) {
+		isolation_work->busy_checks++;
 		schedule_delayed_work(&adev->gfx.enforce_isolation[idx].work,
-				      GFX_SLICE_PERIOD);
+				      min(GFX_SLICE_POLL_PERIOD,
+					  amdgpu_gfx_isolation_slice(adev, idx)));
 	} else {
 		/* Tell KFD to resume the runqueue */
 		if (adev->kfd.init_complete) {
@@ -1804,6 +2096,9 @@ void amdgpu_gfx_enforce_isolation_handler(struct work_struct *work)
 			WARN_ON_ONCE(adev->gfx.kfd_sch_req_count[idx]);
 				amdgpu_amdkfd_start_sched(adev, idx);
 				adev->gfx.kfd_sch_inactive[idx] = false;
+				amdgpu_gfx_isolation_switch(adev, idx, false);
+				/* KFD work leaves state behind as well */
+				atomic_set(&isolation_work->cleaner_owner, 0);
 		}
 	}
 	mutex_unlock(&adev->enforce_isolation_mutex);
@@ -1856,3 +2151,42 @@ void amdgpu_gfx_enforce_isolation_ring_end_use(struct amdgpu_ring *ring)
 	}
 	mutex_unlock(&adev->enforce_isolation_mutex);
 }
+
+/**
+ * amdgpu_gfx_cleaner_shader_needed - check if the cleaner shader must run
+ *
+ * @ring: the ring the job is emitted to
+ * @pasid: PASID of the job, 0 for kernel jobs
+ *
+ * Tracks the owner of the last job emitted with isolation enforced on the
+ * partition of @ring. With the owner change policy the cleaner shader is only
+ * needed when a different owner used the partition in between, or the KFD
+ * ran. Kernel jobs always run it.
+ *
+ * Returns true if the cleaner shader must be emitted.
+ */
+bool amdgpu_gfx_cleaner_shader_needed(struct amdgpu_ring *ring, u32 pasid)
+{
+	struct amdgpu_device *adev = ring->adev;
+	struct amdgpu_isolation_work *iso;
+	u32 idx, prev;
+
+	if (ring->xcp_id == AMDGPU_XCP_NO_PARTITION)
+		idx = 0;
+	else
+		idx = ring->xcp_id;
+
+	if (idx >= MAX_XCP)
+		return true;
+
+	iso = &adev->gfx.enforce_isolation[idx];
+	prev = atomic_xchg(&iso->cleaner_owner, pasid);
+	if (READ_ONCE(adev->gfx.cleaner_shader_policy) ==
+	    AMDGPU_CLEANER_SHADER_OWNER_CHANGE && pasid && prev == pasid) {
+		atomic64_inc(&iso->cleaner_elisions);
+		return false;
+	}
+
+	atomic64_inc(&iso->cleaner_runs);
+	return true;
+}
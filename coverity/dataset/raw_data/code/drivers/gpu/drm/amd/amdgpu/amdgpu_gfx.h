@@ -151,6 +151,20 @@ struct kiq_pm4_funcs {
 	int invalidate_tlbs_size;
 };
 
+/* registers per batched KIQ access, one writeback slot holds 8 dwords */
+#define AMDGPU_KIQ_REG_BATCH	8
+
+struct amdgpu_kiq_stats {
+	/* fences waited for by register accesses */
+	atomic64_t		submissions;
+	/* registers read or written */
+	atomic64_t		regs;
+	/* total time from submission to fence signal */
+	atomic64_t		wait_us;
+	/* accesses which gave up waiting for the fence */
+	atomic64_t		timeouts;
+};
+
 struct amdgpu_kiq {
 	u64			eop_gpu_addr;
 	struct amdgpu_bo	*eop_obj;
@@ -159,6 +173,7 @@ struct amdgpu_kiq {
 	struct amdgpu_irq_src	irq;
 	const struct kiq_pm4_funcs *pmf;
 	void			*mqd_backup;
+	struct amdgpu_kiq_stats	stats;
 };
 
 /*
@@ -350,10 +365,33 @@ struct amdgpu_me {
 	DECLARE_BITMAP(queue_bitmap, AMDGPU_MAX_GFX_QUEUES);
 };
 
+/* cleaner shader policies, see amdgpu_gfx_cleaner_shader_needed() */
+#define AMDGPU_CLEANER_SHADER_ALWAYS		0
+#define AMDGPU_CLEANER_SHADER_OWNER_CHANGE	1
+
+/* default share of GFX_SLICE_PERIOD the KGD keeps the GFX after going idle */
+#define AMDGPU_ISOLATION_WEIGHT_DEFAULT	100
+
 struct amdgpu_isolation_work {
 	struct amdgpu_device		*adev;
 	u32				xcp_id;
 	struct delayed_work		work;
+	/* in percent of GFX_SLICE_PERIOD */
+	u32				weight;
+
+	/* slice statistics, protected by enforce_isolation_mutex */
+	ktime_t				mode_start;
+	u64				kgd_ns;
+	u64				kfd_ns;
+	u64				switches;
+	/* handler runs and how many of them still found KGD work pending */
+	u64				checks;
+	u64				busy_checks;
+
+	/* PASID of the last job emitted with the cleaner shader enabled */
+	atomic_t			cleaner_owner;
+	atomic64_t			cleaner_runs;
+	atomic64_t			cleaner_elisions;
 };
 
 struct amdgpu_gfx {
@@ -467,6 +505,7 @@ struct amdgpu_gfx {
 	void				*cleaner_shader_cpu_ptr;
 	const void			*cleaner_shader_ptr;
 	bool				enable_cleaner_shader;
+	u32				cleaner_shader_policy;
 	struct amdgpu_isolation_work	enforce_isolation[MAX_XCP];
 	/* Mutex for synchronizing KFD scheduler operations */
 	struct mutex                    kfd_sch_mutex;
@@ -559,6 +598,8 @@ int amdgpu_gfx_cp_ecc_error_irq(struct amdgpu_device *adev,
 				  struct amdgpu_iv_entry *entry);
 uint32_t amdgpu_kiq_rreg(struct amdgpu_device *adev, uint32_t reg, uint32_t xcc_id);
 void amdgpu_kiq_wreg(struct amdgpu_device *adev, uint32_t reg, uint32_t v, uint32_t xcc_id);
+int amdgpu_kiq_rreg_batch(struct amdgpu_device *adev, const uint32_t *regs,
+			  uint32_t *vals, uint32_t count, uint32_t xcc_id);
 int amdgpu_gfx_get_num_kcq(struct amdgpu_device *adev);
 void amdgpu_gfx_cp_init_microcode(struct amdgpu_device *adev, uint32_t ucode_id);
 
@@ -584,6 +625,7 @@ void amdgpu_gfx_sysfs_isolation_shader_fini(struct amdgpu_device *adev);
 void amdgpu_gfx_enforce_isolation_handler(struct work_struct *work);
 void amdgpu_gfx_enforce_isolation_ring_begin_use(struct amdgpu_ring *ring);
 void amdgpu_gfx_enforce_isolation_ring_end_use(struct amdgpu_ring *ring);
+bool amdgpu_gfx_cleaner_shader_needed(struct amdgpu_ring *ring, u32 pasid);
 
 static inline const char *amdgpu_gfx_compute_mode_desc(int mode)
 {
@@ -71,14 +71,45 @@ static ssize_t amdgpu_mem_info_gtt_used_show(struct device *dev,
 	return sysfs_emit(buf, "%llu\n", ttm_resource_manager_usage(man));
 }
 
+/**
+ * DOC: mem_info_gtt_numa
+ *
+ * The amdgpu driver provides a sysfs API for reporting how the system memory
+ * backing GTT buffers is spread over the NUMA nodes.
+ * The file mem_info_gtt_numa is used for this, and returns one line per node
+ * with memory, giving the node id and the size allocated from it in bytes.
+ * Placement is controlled by the gtt_numa module parameter.
+ */
+static ssize_t amdgpu_mem_info_gtt_numa_show(struct device *dev,
+					     struct device_attribute *attr,
+					     char *buf)
+{
+	struct drm_device *ddev = dev_get_drvdata(dev);
+	struct amdgpu_device *adev = drm_to_adev(ddev);
+	int nid, size = 0;
+
+	if (!adev->mman.gtt_node_pages)
+		return -ENODEV;
+
+	for_each_node_state(nid, N_MEMORY)
+		size += sysfs_emit_at(buf, size, "%d %llu\n", nid,
+			(u64)atomic64_read(&adev->mman.gtt_node_pages[nid]) <<
+			PAGE_SHIFT);
+
+	return size;
+}
+
 static DEVICE_ATTR(mem_info_gtt_total, S_IRUGO,
 	           amdgpu_mem_info_gtt_total_show, NULL);
 static DEVICE_ATTR(mem_info_gtt_used, S_IRUGO,
 	           amdgpu_mem_info_gtt_used_show, NULL);
+static DEVICE_ATTR(mem_info_gtt_numa, S_IRUGO,
+		   amdgpu_mem_info_gtt_numa_show, NULL);
 
 static struct attribute *amdgpu_gtt_mgr_attributes[] = {
 	&dev_attr_mem_info_gtt_total.attr,
 	&dev_attr_mem_info_gtt_used.attr,
+	&dev_attr_mem_info_gtt_numa.attr,
 	NULL
 };
 
@@ -38,6 +38,54 @@
 #define AMDGPU_IB_TEST_TIMEOUT	msecs_to_jiffies(1000)
 #define AMDGPU_IB_TEST_GFX_XGMI_TIMEOUT	msecs_to_jiffies(2000)
 
+/*
+ * Per ring IB pools
+ *
+ * Delayed IBs of jobs with a known ring are suballocated from a pool owned by
+ * that ring, so IBs stuck behind the fences of a slow ring can't block the
+ * allocations for the other rings. A pool starts with a single chunk and gets
+ * another chunk when allocations had to wait for too long. Chunks which are
+ * not used for new allocations any more are freed again once idle.
+ */
+#define AMDGPU_IB_RING_POOL_SIZE	(128 * 1024)
+#define AMDGPU_IB_RING_POOL_MAX_CHUNKS	8
+#define AMDGPU_IB_RING_POOL_GROW_NS	(1 * NSEC_PER_MSEC)
+#define AMDGPU_IB_RING_POOL_SHRINK_DELAY	msecs_to_jiffies(1000)
+
+struct amdgpu_ib_pool_chunk {
+	struct list_head	list;
+	struct amdgpu_ib_pool	*pool;
+	struct amdgpu_sa_manager sa;
+	/* IBs suballocated from this chunk and not yet freed */
+	unsigned int		live;
+	/* fences the freed IBs of this chunk are still waiting for */
+	struct amdgpu_sync	busy;
+};
+
+struct amdgpu_ib_pool_stats {
+	u64			allocs;
+	/* allocations which blocked longer than the grow threshold */
+	u64			waits;
+	u64			wait_ns;
+	u64			max_wait_ns;
+	u64			grows;
+	u64			shrinks;
+};
+
+struct amdgpu_ib_pool {
+	struct amdgpu_device	*adev;
+	struct amdgpu_ring	*ring;
+	/* protects the chunk list, the chunk usage and the stats */
+	struct mutex		lock;
+	struct list_head	chunks;
+	/* chunk new IBs are allocated from */
+	struct amdgpu_ib_pool_chunk *current_chunk;
+	unsigned int		num_chunks;
+	struct amdgpu_ib_pool_stats stats;
+	struct work_struct	grow_work;
+	struct delayed_work	shrink_work;
+};
+
 /*
  * IB
  * IBs (Indirect Buffers) and areas of GPU accessible memory where
@@ -67,6 +115,7 @@ int amdgpu_ib_get(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 {
 	int r;
 
+	ib->chunk = NULL;
 	if (size) {
 		r = amdgpu_sa_bo_new(&adev->ib_pools[pool_type],
 				     &ib->sa_bo, size);
@@ -86,6 +135,74 @@ int amdgpu_ib_get(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 	return 0;
 }
 
+/**
+ * amdgpu_ib_get_ring - request an IB for a specific ring
+ *
+ * @adev: amdgpu_device pointer
+ * @ring: ring the IB is most likely executed on, may be NULL
+ * @size: requested IB size
+ * @pool_type: IB pool type (delayed, immediate, direct)
+ * @ib: IB object returned
+ *
+ * Like amdgpu_ib_get(), but delayed IBs are allocated from the pool of @ring
+ * if it has one. Only used for kernel IBs which don't use a VM.
+ * Returns 0 on success, error on failure.
+ */
+int amdgpu_ib_get_ring(struct amdgpu_device *adev, struct amdgpu_ring *ring,
+		       unsigned int size, enum amdgpu_ib_pool_type pool_type,
+		       struct amdgpu_ib *ib)
+{
+	struct amdgpu_ib_pool_chunk *chunk;
+	struct amdgpu_ib_pool *pool;
+	s64 wait_ns;
+	ktime_t start;
+	int r;
+
+	pool = ring ? adev->ring_ib_pools[ring->idx] : NULL;
+	if (!size || !pool || pool_type != AMDGPU_IB_POOL_DELAYED)
+		return amdgpu_ib_get(adev, NULL, size, pool_type, ib);
+
+	mutex_lock(&pool->lock);
+	chunk = pool->current_chunk;
+	++chunk->live;
+	mutex_unlock(&pool->lock);
+
+	start = ktime_get();
+	r = amdgpu_sa_bo_new(&chunk->sa, &ib->sa_bo, size);
+	wait_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	mutex_lock(&pool->lock);
+	if (r) {
+		--chunk->live;
+	} else {
+		++pool->stats.allocs;
+		pool->stats.wait_ns += wait_ns;
+		pool->stats.max_wait_ns = max_t(u64, pool->stats.max_wait_ns,
+						 wait_ns);
+	}
+	if (wait_ns > AMDGPU_IB_RING_POOL_GROW_NS) {
+		++pool->stats.waits;
+		/* Grow from a worker, we might be called during eviction */
+		if (chunk == pool->current_chunk &&
+		    pool->num_chunks < AMDGPU_IB_RING_POOL_MAX_CHUNKS)
+			schedule_work(&pool->grow_work);
+	}
+	mutex_unlock(&pool->lock);
+
+	if (r) {
+		dev_err(adev->dev, "failed to get a new IB (%d)\n", r);
+		return r;
+	}
+
+	ib->chunk = chunk;
+	ib->ptr = amdgpu_sa_bo_cpu_addr(ib->sa_bo);
+	/* flush the cache before commit the IB */
+	ib->flags = AMDGPU_IB_FLAG_EMIT_MEM_SYNC;
+	ib->gpu_addr = amdgpu_sa_bo_gpu_addr(ib->sa_bo);
+
+	return 0;
+}
+
 /**
  * amdgpu_ib_free - free an IB (Indirect Buffer)
  *
@@ -98,6 +215,20 @@ int amdgpu_ib_get(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 void amdgpu_ib_free(struct amdgpu_device *adev, struct amdgpu_ib *ib,
 		    struct dma_fence *f)
 {
+	struct amdgpu_ib_pool_chunk *chunk = ib->chunk;
+
+	if (ib->sa_bo && chunk) {
+		struct amdgpu_ib_pool *pool = chunk->pool;
+
+		mutex_lock(&pool->lock);
+		/* Last resort when we are OOM, the chunk must stay alive */
+		if (f && amdgpu_sync_fence(&chunk->busy, f))
+			dma_fence_wait(f, false);
+		--chunk->live;
+		mutex_unlock(&pool->lock);
+		ib->chunk = NULL;
+	}
+
 	amdgpu_sa_bo_free(adev, &ib->sa_bo, f);
 }
 
@@ -311,13 +442,146 @@ int amdgpu_ib_schedule(struct amdgpu_ring *ring, unsigned int num_ibs,
 	return 0;
 }
 
+static struct amdgpu_ib_pool_chunk *
+amdgpu_ib_pool_chunk_create(struct amdgpu_ib_pool *pool)
+{
+	struct amdgpu_ib_pool_chunk *chunk;
+	int r;
+
+	chunk = kzalloc(sizeof(*chunk), GFP_KERNEL);
+	if (!chunk)
+		return ERR_PTR(-ENOMEM);
+
+	r = amdgpu_sa_bo_manager_init(pool->adev, &chunk->sa,
+				      AMDGPU_IB_RING_POOL_SIZE, 256,
+				      AMDGPU_GEM_DOMAIN_GTT);
+	if (r) {
+		kfree(chunk);
+		return ERR_PTR(r);
+	}
+
+	chunk->pool = pool;
+	amdgpu_sync_create(&chunk->busy);
+	return chunk;
+}
+
+static void amdgpu_ib_pool_chunk_free(struct amdgpu_ib_pool *pool,
+				      struct amdgpu_ib_pool_chunk *chunk)
+{
+	amdgpu_sync_free(&chunk->busy);
+	amdgpu_sa_bo_manager_fini(pool->adev, &chunk->sa);
+	kfree(chunk);
+}
+
+static void amdgpu_ib_pool_grow_work(struct work_struct *work)
+{
+	struct amdgpu_ib_pool *pool =
+		container_of(work, struct amdgpu_ib_pool, grow_work);
+	struct amdgpu_ib_pool_chunk *chunk;
+
+	chunk = amdgpu_ib_pool_chunk_create(pool);
+	if (IS_ERR(chunk))
+		return;
+
+	mutex_lock(&pool->lock);
+	if (pool->num_chunks < AMDGPU_IB_RING_POOL_MAX_CHUNKS) {
+		list_add_tail(&chunk->list, &pool->chunks);
+		pool->current_chunk = chunk;
+		++pool->num_chunks;
+		++pool->stats.grows;
+		schedule_delayed_work(&pool->shrink_work,
+				      AMDGPU_IB_RING_POOL_SHRINK_DELAY);
+		chunk = NULL;
+	}
+	mutex_unlock(&pool->lock);
+
+	if (chunk)
+		amdgpu_ib_pool_chunk_free(pool, chunk);
+}
+
+static void amdgpu_ib_pool_shrink_work(struct work_struct *work)
+{
+	struct amdgpu_ib_pool *pool =
+		container_of(work, struct amdgpu_ib_pool, shrink_work.work);
+	struct amdgpu_ib_pool_chunk *chunk, *tmp;
+	LIST_HEAD(idle);
+
+	mutex_lock(&pool->lock);
+	list_for_each_entry_safe(chunk, tmp, &pool->chunks, list) {
+		if (chunk == pool->current_chunk || chunk->live ||
+		    amdgpu_sync_peek_fence(&chunk->busy, NULL))
+			continue;
+
+		list_move(&chunk->list, &idle);
+		--pool->num_chunks;
+		++pool->stats.shrinks;
+	}
+
+	if (pool->num_chunks > 1)
+		schedule_delayed_work(&pool->shrink_work,
+				      AMDGPU_IB_RING_POOL_SHRINK_DELAY);
+	mutex_unlock(&pool->lock);
+
+	list_for_each_entry_safe(chunk, tmp, &idle, list)
+		amdgpu_ib_pool_chunk_free(pool, chunk);
+}
+
+static void amdgpu_ib_ring_pool_fini(struct amdgpu_ib_pool *pool)
+{
+	struct amdgpu_ib_pool_chunk *chunk, *tmp;
+
+	cancel_work_sync(&pool->grow_work);
+	cancel_delayed_work_sync(&pool->shrink_work);
+
+	list_for_each_entry_safe(chunk, tmp, &pool->chunks, list) {
+		list_del(&chunk->list);
+		amdgpu_sync_wait(&chunk->busy, false);
+		amdgpu_ib_pool_chunk_free(pool, chunk);
+	}
+
+	mutex_destroy(&pool->lock);
+	kfree(pool);
+}
+
+static int amdgpu_ib_ring_pool_init(struct amdgpu_device *adev,
+				    struct amdgpu_ring *ring)
+{
+	struct amdgpu_ib_pool_chunk *chunk;
+	struct amdgpu_ib_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return -ENOMEM;
+
+	pool->adev = adev;
+	pool->ring = ring;
+	mutex_init(&pool->lock);
+	INIT_LIST_HEAD(&pool->chunks);
+	INIT_WORK(&pool->grow_work, amdgpu_ib_pool_grow_work);
+	INIT_DELAYED_WORK(&pool->shrink_work, amdgpu_ib_pool_shrink_work);
+
+	chunk = amdgpu_ib_pool_chunk_create(pool);
+	if (IS_ERR(chunk)) {
+		mutex_destroy(&pool->lock);
+		kfree(pool);
+		return PTR_ERR(chunk);
+	}
+
+	list_add_tail(&chunk->list, &pool->chunks);
+	pool->current_chunk = chunk;
+	pool->num_chunks = 1;
+	adev->ring_ib_pools[ring->idx] = pool;
+	return 0;
+}
+
 /**
  * amdgpu_ib_pool_init - Init the IB (Indirect Buffer) pool
  *
  * @adev: amdgpu_device pointer
  *
  * Initialize the suballocator to manage a pool of memory
- * for use as IBs (all asics).
+ * for use as IBs (all asics), plus the per ring pools for
+ * every ring which uses the scheduler.
  * Returns 0 on success, error on failure.
  */
 int amdgpu_ib_pool_init(struct amdgpu_device *adev)
@@ -334,6 +598,21 @@ int amdgpu_ib_pool_init(struct amdgpu_device *adev)
 		if (r)
 			goto error;
 	}
+
+	for (i = 0; i < adev->num_rings; i++) {
+		struct amdgpu_ring *ring = adev->rings[i];
+
+		if (!ring || ring->no_scheduler ||
+		    ring->funcs->type == AMDGPU_RING_TYPE_KIQ ||
+		    ring->funcs->type == AMDGPU_RING_TYPE_MES)
+			continue;
+
+		/* Not fatal, the ring just shares the device wide pools */
+		r = amdgpu_ib_ring_pool_init(adev, ring);
+		if (r)
+			dev_warn(adev->dev, "no IB pool for ring %s (%d)\n",
+				 ring->name, r);
+	}
 	adev->ib_pool_ready = true;
 
 	return 0;
@@ -359,6 +638,14 @@ void amdgpu_ib_pool_fini(struct amdgpu_device *adev)
 	if (!adev->ib_pool_ready)
 		return;
 
+	for (i = 0; i < AMDGPU_MAX_RINGS; i++) {
+		if (!adev->ring_ib_pools[i])
+			continue;
+
+		amdgpu_ib_ring_pool_fini(adev->ring_ib_pools[i]);
+		adev->ring_ib_pools[i] = NULL;
+	}
+
 	for (i = 0; i < AMDGPU_IB_POOL_MAX; i++)
 		amdgpu_sa_bo_manager_fini(adev, &adev->ib_pools[i]);
 	adev->ib_pool_ready = false;
@@ -457,6 +744,7 @@ int amdgpu_ib_ring_tests(struct amdgpu_device *adev)
 static int amdgpu_debugfs_sa_info_show(struct seq_file *m, void *unused)
 {
 	struct amdgpu_device *adev = m->private;
+	int i;
 
 	seq_puts(m, "--------------------- DELAYED ---------------------\n");
 	amdgpu_sa_bo_dump_debug_info(&adev->ib_pools[AMDGPU_IB_POOL_DELAYED],
@@ -467,6 +755,36 @@ static int amdgpu_debugfs_sa_info_show(struct seq_file *m, void *unused)
 	seq_puts(m, "--------------------- DIRECT ----------------------\n");
 	amdgpu_sa_bo_dump_debug_info(&adev->ib_pools[AMDGPU_IB_POOL_DIRECT], m);
 
+	for (i = 0; i < AMDGPU_MAX_RINGS; i++) {
+		struct amdgpu_ib_pool *pool = adev->ring_ib_pools[i];
+		struct amdgpu_ib_pool_chunk *chunk;
+		struct amdgpu_ib_pool_stats stats;
+		unsigned int live = 0;
+
+		if (!pool)
+			continue;
+
+		mutex_lock(&pool->lock);
+		stats = pool->stats;
+		list_for_each_entry(chunk, &pool->chunks, list)
+			live += chunk->live;
+		seq_printf(m, "------------------ RING %s ------------------\n",
+			   pool->ring->name);
+		seq_printf(m, "chunks %u (%u KiB), live IBs %u\n",
+			   pool->num_chunks,
+			   pool->num_chunks * AMDGPU_IB_RING_POOL_SIZE / 1024,
+			   live);
+		seq_printf(m, "allocs %llu, waits %llu, avg wait %llu ns, max wait %llu ns\n",
+			   stats.allocs, stats.waits,
+			   stats.allocs ? div64_u64(stats.wait_ns, stats.allocs) : 0,
+			   stats.max_wait_ns);
+		seq_printf(m, "grows %llu, shrinks %llu\n",
+			   stats.grows, stats.shrinks);
+		list_for_each_entry(chunk, &pool->chunks, list)
+			amdgpu_sa_bo_dump_debug_info(&chunk->sa, m);
+		mutex_unlock(&pool->lock);
+	}
+
 	return 0;
 }
 
@@ -24,6 +24,7 @@
 
 #include <linux/idr.h>
 #include <linux/dma-fence-array.h>
+#include <linux/debugfs.h>
 
 
 #include "amdgpu.h"
@@ -184,6 +185,35 @@ static bool amdgpu_vmid_compatible(struct amdgpu_vmid *id,
 		!amdgpu_vmid_gds_switch_needed(id, job);
 }
 
+/*
+ * Remember this submission as user of the VMID. The ID is not idle any more
+ * until all of its fences signaled and a LRU walk rediscovered it.
+ */
+static int amdgpu_vmid_add_user(struct amdgpu_vmid_mgr *id_mgr,
+				struct amdgpu_vmid *id,
+				struct amdgpu_job *job)
+{
+	__clear_bit(id - id_mgr->ids, id_mgr->idle);
+	return amdgpu_sync_fence(&id->active, &job->base.s_fence->finished);
+}
+
+/* Return the least recently used VMID which is known to be idle */
+static struct amdgpu_vmid *
+amdgpu_vmid_first_idle(struct amdgpu_vmid_mgr *id_mgr)
+{
+	struct amdgpu_vmid *idle = NULL;
+	unsigned int i;
+
+	for_each_set_bit(i, id_mgr->idle, AMDGPU_NUM_VMID) {
+		struct amdgpu_vmid *id = &id_mgr->ids[i];
+
+		if (!idle || id->lru_stamp < idle->lru_stamp)
+			idle = id;
+	}
+
+	return idle;
+}
+
 /**
  * amdgpu_vmid_grab_idle - grab idle VMID
  *
@@ -192,7 +222,9 @@ static bool amdgpu_vmid_compatible(struct amdgpu_vmid *id,
  * @fence: fence to wait for if no id could be grabbed
  *
  * Try to find an idle VMID, if none is idle add a fence to wait to the sync
- * object. Returns -ENOMEM when we are out of memory.
+ * object. IDs found idle are cached in the idle bitmap, so that following
+ * grabs don't need to walk the LRU again. Memory is only allocated when we
+ * have to wait. Returns -ENOMEM when we are out of memory.
  */
 static int amdgpu_vmid_grab_idle(struct amdgpu_ring *ring,
 				 struct amdgpu_vmid **idle,
@@ -201,7 +233,8 @@ static int amdgpu_vmid_grab_idle(struct amdgpu_ring *ring,
 	struct amdgpu_device *adev = ring->adev;
 	unsigned vmhub = ring->vm_hub;
 	struct amdgpu_vmid_mgr *id_mgr = &adev->vm_manager.id_mgr[vmhub];
-	struct dma_fence **fences;
+	struct dma_fence *fences[AMDGPU_NUM_VMID];
+	struct amdgpu_ring *r;
 	unsigned i;
 
 	if (!dma_fence_is_signaled(ring->vmid_wait)) {
@@ -209,17 +242,16 @@ static int amdgpu_vmid_grab_idle(struct amdgpu_ring *ring,
 		return 0;
 	}
 
-	fences = kmalloc_array(id_mgr->num_ids, sizeof(void *), GFP_KERNEL);
-	if (!fences)
-		return -ENOMEM;
+	*idle = amdgpu_vmid_first_idle(id_mgr);
+	if (*idle)
+		return 0;
+
+	/* Don't use per engine and per process VMID at the same time */
+	r = adev->vm_manager.concurrent_flush ? NULL : ring;
 
 	/* Check if we have an idle VMID */
 	i = 0;
 	list_for_each_entry((*idle), &id_mgr->ids_lru, list) {
-		/* Don't use per engine and per process VMID at the same time */
-		struct amdgpu_ring *r = adev->vm_manager.concurrent_flush ?
-			NULL : ring;
-
 		fences[i] = amdgpu_sync_peek_fence(&(*idle)->active, r);
 		if (!fences[i])
 			break;
@@ -231,18 +263,23 @@ static int amdgpu_vmid_grab_idle(struct amdgpu_ring *ring,
 		u64 fence_context = adev->vm_manager.fence_context + ring->idx;
 		unsigned seqno = ++adev->vm_manager.seqno[ring->idx];
 		struct dma_fence_array *array;
+		struct dma_fence **array_fences;
 		unsigned j;
 
 		*idle = NULL;
+		array_fences = kmemdup(fences, i * sizeof(void *), GFP_KERNEL);
+		if (!array_fences)
+			return -ENOMEM;
+
 		for (j = 0; j < i; ++j)
-			dma_fence_get(fences[j]);
+			dma_fence_get(array_fences[j]);
 
-		array = dma_fence_array_create(i, fences, fence_context,
+		array = dma_fence_array_create(i, array_fences, fence_context,
 					       seqno, true);
 		if (!array) {
 			for (j = 0; j < i; ++j)
-				dma_fence_put(fences[j]);
-			kfree(fences);
+				dma_fence_put(array_fences[j]);
+			kfree(array_fences);
 			return -ENOMEM;
 		}
 
@@ -251,7 +288,10 @@ static int amdgpu_vmid_grab_idle(struct amdgpu_ring *ring,
 		ring->vmid_wait = &array->base;
 		return 0;
 	}
-	kfree(fences);
+
+	/* Only cache IDs which are idle for all rings */
+	if (!r || !amdgpu_sync_peek_fence(&(*idle)->active, NULL))
+		__set_bit(*idle - id_mgr->ids, id_mgr->idle);
 
 	return 0;
 }
@@ -326,7 +366,7 @@ static int amdgpu_vmid_grab_reserved(struct amdgpu_vm *vm,
 	/* Good we can use this VMID. Remember this submission as
 	* user of the VMID.
 	*/
-	r = amdgpu_sync_fence(&(*id)->active, &job->base.s_fence->finished);
+	r = amdgpu_vmid_add_user(id_mgr, *id, job);
 	if (r)
 		return r;
 
@@ -335,6 +375,36 @@ static int amdgpu_vmid_grab_reserved(struct amdgpu_vm *vm,
 	return 0;
 }
 
+/* Check all the prerequisites to reuse a VMID already assigned to this VM */
+static bool amdgpu_vmid_reusable(struct amdgpu_vm *vm,
+				 struct amdgpu_ring *ring,
+				 struct amdgpu_job *job,
+				 struct amdgpu_vmid *id,
+				 bool *needs_flush)
+{
+	struct amdgpu_device *adev = ring->adev;
+	uint64_t fence_context = adev->fence_context + ring->idx;
+	uint64_t updates = amdgpu_vm_tlb_seq(vm);
+
+	*needs_flush = vm->use_cpu_for_update;
+
+	if (id->owner != vm->immediate.fence_context)
+		return false;
+
+	if (!amdgpu_vmid_compatible(id, job))
+		return false;
+
+	if (!id->last_flush ||
+	    (id->last_flush->context != fence_context &&
+	     !dma_fence_is_signaled(id->last_flush)))
+		*needs_flush = true;
+
+	if (id->flushed_updates < updates)
+		*needs_flush = true;
+
+	return !*needs_flush || adev->vm_manager.concurrent_flush;
+}
+
 /**
  * amdgpu_vmid_grab_used - try to reuse a VMID
  *
@@ -344,7 +414,9 @@ static int amdgpu_vmid_grab_reserved(struct amdgpu_vm *vm,
  * @id: resulting VMID
  * @fence: fence to wait for if no id could be grabbed
  *
- * Try to reuse a VMID for this submission.
+ * Try to reuse a VMID for this submission. The VMID last used by the VM on
+ * this hub is tried first, which usually avoids walking the LRU and keeps the
+ * VM on an ID which doesn't need a TLB flush.
  */
 static int amdgpu_vmid_grab_used(struct amdgpu_vm *vm,
 				 struct amdgpu_ring *ring,
@@ -355,48 +427,41 @@ static int amdgpu_vmid_grab_used(struct amdgpu_vm *vm,
 	struct amdgpu_device *adev = ring->adev;
 	unsigned vmhub = ring->vm_hub;
 	struct amdgpu_vmid_mgr *id_mgr = &adev->vm_manager.id_mgr[vmhub];
-	uint64_t fence_context = adev->fence_context + ring->idx;
-	uint64_t updates = amdgpu_vm_tlb_seq(vm);
+	unsigned int hint = vm->vmid_hint[vmhub];
+	bool needs_flush;
 	int r;
 
 	job->vm_needs_flush = vm->use_cpu_for_update;
 
+	if (hint && hint < id_mgr->num_ids) {
+		*id = &id_mgr->ids[hint];
+		if (*id != id_mgr->reserved &&
+		    amdgpu_vmid_reusable(vm, ring, job, *id, &needs_flush)) {
+			++id_mgr->stats.hint_hits;
+			goto found;
+		}
+	}
+
 	/* Check if we can use a VMID already assigned to this VM */
 	list_for_each_entry_reverse((*id), &id_mgr->ids_lru, list) {
-		bool needs_flush = vm->use_cpu_for_update;
-
-		/* Check all the prerequisites to using this VMID */
-		if ((*id)->owner != vm->immediate.fence_context)
-			continue;
-
-		if (!amdgpu_vmid_compatible(*id, job))
-			continue;
-
-		if (!(*id)->last_flush ||
-		    ((*id)->last_flush->context != fence_context &&
-		     !dma_fence_is_signaled((*id)->last_flush)))
-			needs_flush = true;
-
-		if ((*id)->flushed_updates < updates)
-			needs_flush = true;
-
-		if (needs_flush && !adev->vm_manager.concurrent_flush)
-			continue;
-
-		/* Good, we can use this VMID. Remember this submission as
-		 * user of the VMID.
-		 */
-		r = amdgpu_sync_fence(&(*id)->active,
-				      &job->base.s_fence->finished);
-		if (r)
-			return r;
-
-		job->vm_needs_flush |= needs_flush;
-		return 0;
+		if (amdgpu_vmid_reusable(vm, ring, job, *id, &needs_flush))
+			goto found;
 	}
 
 	*id = NULL;
 	return 0;
+
+found:
+	/* Good, we can use this VMID. Remember this submission as
+	 * user of the VMID.
+	 */
+	r = amdgpu_vmid_add_user(id_mgr, *id, job);
+	if (r)
+		return r;
+
+	job->vm_needs_flush |= needs_flush;
+	++id_mgr->stats.reuses;
+	return 0;
 }
 
 /**
@@ -421,13 +486,19 @@ int amdgpu_vmid_grab(struct amdgpu_vm *vm, struct amdgpu_ring *ring,
 
 	mutex_lock(&id_mgr->lock);
 	r = amdgpu_vmid_grab_idle(ring, &idle, fence);
-	if (r || !idle)
+	if (r || !idle) {
+		if (!r)
+			++id_mgr->stats.waits;
 		goto error;
+	}
 
 	if (amdgpu_vmid_uses_reserved(adev, vm, vmhub)) {
 		r = amdgpu_vmid_grab_reserved(vm, ring, job, &id, fence);
-		if (r || !id)
+		if (r || !id) {
+			if (!r)
+				++id_mgr->stats.waits;
 			goto error;
+		}
 	} else {
 		r = amdgpu_vmid_grab_used(vm, ring, job, &id, fence);
 		if (r)
@@ -438,15 +509,17 @@ int amdgpu_vmid_grab(struct amdgpu_vm *vm, struct amdgpu_ring *ring,
 			id = idle;
 
 			/* Remember this submission as user of the VMID */
-			r = amdgpu_sync_fence(&id->active,
-					      &job->base.s_fence->finished);
+			r = amdgpu_vmid_add_user(id_mgr, id, job);
 			if (r)
 				goto error;
 
 			job->vm_needs_flush = true;
+			++id_mgr->stats.steals;
 		}
 
 		list_move_tail(&id->list, &id_mgr->ids_lru);
+		id->lru_stamp = ++id_mgr->lru_stamp;
+		vm->vmid_hint[vmhub] = id - id_mgr->ids;
 	}
 
 	job->gds_switch_needed = amdgpu_vmid_gds_switch_needed(id, job);
@@ -466,6 +539,7 @@ int amdgpu_vmid_grab(struct amdgpu_vm *vm, struct amdgpu_ring *ring,
 	id->oa_size = job->oa_size;
 	id->pd_gpu_addr = job->vm_pd_addr;
 	id->owner = vm->immediate.fence_context;
+	++id_mgr->stats.grabs;
 
 	trace_amdgpu_vm_grab_id(vm, ring, job);
 
@@ -506,6 +580,7 @@ int amdgpu_vmid_alloc_reserved(struct amdgpu_device *adev,
 				      list);
 		/* Remove from normal round robin handling */
 		list_del_init(&id->list);
+		__clear_bit(id - id_mgr->ids, id_mgr->idle);
 		id_mgr->reserved = id;
 	}
 
@@ -522,6 +597,7 @@ void amdgpu_vmid_free_reserved(struct amdgpu_device *adev,
 	if (!--id_mgr->reserved_use_count) {
 		/* give the reserved ID back to normal round robin */
 		list_add(&id_mgr->reserved->list, &id_mgr->ids_lru);
+		id_mgr->reserved->lru_stamp = 0;
 		id_mgr->reserved = NULL;
 	}
 
@@ -591,7 +667,10 @@ void amdgpu_vmid_mgr_init(struct amdgpu_device *adev)
 
 		mutex_init(&id_mgr->lock);
 		INIT_LIST_HEAD(&id_mgr->ids_lru);
+		bitmap_zero(id_mgr->idle, AMDGPU_NUM_VMID);
+		id_mgr->lru_stamp = 0;
 		id_mgr->reserved_use_count = 0;
+		memset(&id_mgr->stats, 0, sizeof(id_mgr->stats));
 
 		/* manage only VMIDs not used by KFD */
 		id_mgr->num_ids = adev->vm_manager.first_kfd_vmid;
@@ -601,6 +680,8 @@ void amdgpu_vmid_mgr_init(struct amdgpu_device *adev)
 			amdgpu_vmid_reset(adev, i, j);
 			amdgpu_sync_create(&id_mgr->ids[j].active);
 			list_add_tail(&id_mgr->ids[j].list, &id_mgr->ids_lru);
+			id_mgr->ids[j].lru_stamp = ++id_mgr->lru_stamp;
+			__set_bit(j, id_mgr->idle);
 		}
 	}
 	/* alloc a default reserved vmid to enforce isolation */
@@ -635,3 +716,51 @@ void amdgpu_vmid_mgr_fini(struct amdgpu_device *adev)
 		}
 	}
 }
+
+/*
+ * Debugfs info
+ */
+#if defined(CONFIG_DEBUG_FS)
+
+static int amdgpu_debugfs_vmid_info_show(struct seq_file *m, void *unused)
+{
+	struct amdgpu_device *adev = m->private;
+	unsigned int i;
+
+	for_each_set_bit(i, adev->vmhubs_mask, AMDGPU_MAX_VMHUBS) {
+		struct amdgpu_vmid_mgr *id_mgr = &adev->vm_manager.id_mgr[i];
+		struct amdgpu_vmid_stats stats;
+		unsigned int num_idle;
+
+		mutex_lock(&id_mgr->lock);
+		stats = id_mgr->stats;
+		num_idle = bitmap_weight(id_mgr->idle, AMDGPU_NUM_VMID);
+		mutex_unlock(&id_mgr->lock);
+
+		seq_printf(m, "vmhub %u: %u ids, %u known idle%s\n", i,
+			   id_mgr->num_ids, num_idle,
+			   id_mgr->reserved ? ", 1 reserved" : "");
+		seq_printf(m, "\tgrabs:     %llu\n", stats.grabs);
+		seq_printf(m, "\treuses:    %llu\n", stats.reuses);
+		seq_printf(m, "\thint hits: %llu\n", stats.hint_hits);
+		seq_printf(m, "\tsteals:    %llu\n", stats.steals);
+		seq_printf(m, "\twaits:     %llu\n", stats.waits);
+	}
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(amdgpu_debugfs_vmid_info);
+
+#endif
+
+void amdgpu_debugfs_vmid_init(struct amdgpu_device *adev)
+{
+#if defined(CONFIG_DEBUG_FS)
+	struct drm_minor *minor = adev_to_drm(adev)->primary;
+	struct dentry *root = minor->debugfs_root;
+
+	debugfs_create_file("amdgpu_vmid_info", 0444, root, adev,
+			    &amdgpu_debugfs_vmid_info_fops);
+#endif
+}
@@ -26,6 +26,7 @@
 #include <linux/types.h>
 #include <linux/mutex.h>
 #include <linux/list.h>
+#include <linux/bitmap.h>
 #include <linux/dma-fence.h>
 
 #include "amdgpu_sync.h"
@@ -41,6 +42,8 @@ struct amdgpu_job;
 
 struct amdgpu_vmid {
 	struct list_head	list;
+	/* position in the LRU, used to order idle candidates */
+	uint64_t		lru_stamp;
 	struct amdgpu_sync	active;
 	struct dma_fence	*last_flush;
 	uint64_t		owner;
@@ -62,13 +65,30 @@ struct amdgpu_vmid {
 	struct dma_fence	*pasid_mapping;
 };
 
+struct amdgpu_vmid_stats {
+	/* total number of successful grabs */
+	uint64_t		grabs;
+	/* grabs which reused an ID already owned by the VM */
+	uint64_t		reuses;
+	/* reuses satisfied by the per VM hint without walking the LRU */
+	uint64_t		hint_hits;
+	/* grabs which took an idle ID from another owner and must flush */
+	uint64_t		steals;
+	/* grabs which had to wait for an ID to become idle */
+	uint64_t		waits;
+};
+
 struct amdgpu_vmid_mgr {
 	struct mutex		lock;
 	unsigned		num_ids;
 	struct list_head	ids_lru;
 	struct amdgpu_vmid	ids[AMDGPU_NUM_VMID];
+	/* IDs known to have no unsignaled fences in their active sync */
+	DECLARE_BITMAP(idle, AMDGPU_NUM_VMID);
+	uint64_t		lru_stamp;
 	struct amdgpu_vmid	*reserved;
 	unsigned int		reserved_use_count;
+	struct amdgpu_vmid_stats stats;
 };
 
 int amdgpu_pasid_alloc(unsigned int bits);
@@ -92,5 +112,6 @@ void amdgpu_vmid_reset_all(struct amdgpu_device *adev);
 
 void amdgpu_vmid_mgr_init(struct amdgpu_device *adev);
 void amdgpu_vmid_mgr_fini(struct amdgpu_device *adev);
+void amdgpu_debugfs_vmid_init(struct amdgpu_device *adev);
 
 #endif
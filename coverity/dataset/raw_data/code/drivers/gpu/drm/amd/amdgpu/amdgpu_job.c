@@ -102,6 +102,19 @@ static enum drm_gpu_sched_stat amdgpu_job_timedout(struct drm_sched_job *s_job)
 		return DRM_GPU_SCHED_STAT_ENODEV;
 	}
 
+	if (amdgpu_hang_watchdog > 0 &&
+	    !amdgpu_ring_hangcheck(ring, s_job->s_fence->parent)) {
+		dev_dbg(adev->dev, "ring %s timeout, but still making progress\n",
+			s_job->sched->name);
+
+		/* The scheduler removed the job, put it back for the next timeout */
+		spin_lock(&s_job->sched->job_list_lock);
+		list_add(&s_job->list, &s_job->sched->pending_list);
+		spin_unlock(&s_job->sched->job_list_lock);
+		drm_dev_exit(idx);
+		return DRM_GPU_SCHED_STAT_NOMINAL;
+	}
+
 	adev->job_hang = true;
 
 	/*
@@ -214,14 +227,19 @@ int amdgpu_job_alloc_with_ib(struct amdgpu_device *adev,
 			     size_t size, enum amdgpu_ib_pool_type pool_type,
 			     struct amdgpu_job **job)
 {
+	struct amdgpu_ring *ring = NULL;
 	int r;
 
 	r = amdgpu_job_alloc(adev, NULL, entity, owner, 1, job);
 	if (r)
 		return r;
 
+	/* Use the pool of the ring the entity currently feeds */
+	if (entity && entity->rq)
+		ring = to_amdgpu_ring(entity->rq->sched);
+
 	(*job)->num_ibs = 1;
-	r = amdgpu_ib_get(adev, NULL, size, pool_type, &(*job)->ibs[0]);
+	r = amdgpu_ib_get_ring(adev, ring, size, pool_type, &(*job)->ibs[0]);
 	if (r) {
 		if (entity)
 			drm_sched_job_cleanup(&(*job)->base);
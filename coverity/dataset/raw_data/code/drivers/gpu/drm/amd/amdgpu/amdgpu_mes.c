@@ -332,6 +332,7 @@ void amdgpu_mes_destroy_process(struct amdgpu_device *adev, int pasid)
 	struct amdgpu_mes_gang *gang, *tmp1;
 	struct amdgpu_mes_queue *queue, *tmp2;
 	struct mes_remove_queue_input queue_input;
+	struct amdgpu_mes_api_deferred deferred;
 	unsigned long flags;
 	int r;
 
@@ -339,12 +340,12 @@ void amdgpu_mes_destroy_process(struct amdgpu_device *adev, int pasid)
 	 * Avoid taking any other locks under MES lock to avoid circular
 	 * lock dependencies.
 	 */
-	amdgpu_mes_lock(&adev->mes);
+	amdgpu_mes_lock_deferred(&adev->mes, &deferred);
 
 	process = idr_find(&adev->mes.pasid_idr, pasid);
 	if (!process) {
 		DRM_WARN("pasid %d doesn't exist\n", pasid);
-		amdgpu_mes_unlock(&adev->mes);
+		amdgpu_mes_unlock_deferred(&adev->mes, &deferred);
 		return;
 	}
 
@@ -368,7 +369,10 @@ void amdgpu_mes_destroy_process(struct amdgpu_device *adev, int pasid)
 	}
 
 	idr_remove(&adev->mes.pasid_idr, pasid);
-	amdgpu_mes_unlock(&adev->mes);
+
+	/* Wait for the removals before freeing what MES still uses */
+	if (amdgpu_mes_unlock_deferred(&adev->mes, &deferred))
+		DRM_WARN("failed to remove hardware queues\n");
 
 	/* free all memory allocated by the process */
 	list_for_each_entry_safe(gang, tmp1, &process->gang_list, list) {
@@ -502,6 +506,7 @@ int amdgpu_mes_remove_gang(struct amdgpu_device *adev, int gang_id)
 int amdgpu_mes_suspend(struct amdgpu_device *adev)
 {
 	struct mes_suspend_gang_input input;
+	struct amdgpu_mes_api_deferred deferred;
 	int r;
 
 	if (!amdgpu_mes_suspend_resume_all_supported(adev))
@@ -514,9 +519,10 @@ int amdgpu_mes_suspend(struct amdgpu_device *adev)
 	 * Avoid taking any other locks under MES lock to avoid circular
 	 * lock dependencies.
 	 */
-	amdgpu_mes_lock(&adev->mes);
+	amdgpu_mes_lock_deferred(&adev->mes, &deferred);
 	r = adev->mes.funcs->suspend_gang(&adev->mes, &input);
-	amdgpu_mes_unlock(&adev->mes);
+	if (amdgpu_mes_unlock_deferred(&adev->mes, &deferred))
+		r = -ETIMEDOUT;
 	if (r)
 		DRM_ERROR("failed to suspend all gangs");
 
@@ -526,6 +532,7 @@ int amdgpu_mes_suspend(struct amdgpu_device *adev)
 int amdgpu_mes_resume(struct amdgpu_device *adev)
 {
 	struct mes_resume_gang_input input;
+	struct amdgpu_mes_api_deferred deferred;
 	int r;
 
 	if (!amdgpu_mes_suspend_resume_all_supported(adev))
@@ -538,9 +545,10 @@ int amdgpu_mes_resume(struct amdgpu_device *adev)
 	 * Avoid taking any other locks under MES lock to avoid circular
 	 * lock dependencies.
 	 */
-	amdgpu_mes_lock(&adev->mes);
+	amdgpu_mes_lock_deferred(&adev->mes, &deferred);
 	r = adev->mes.funcs->resume_gang(&adev->mes, &input);
-	amdgpu_mes_unlock(&adev->mes);
+	if (amdgpu_mes_unlock_deferred(&adev->mes, &deferred))
+		r = -ETIMEDOUT;
 	if (r)
 		DRM_ERROR("failed to resume all gangs");
 
@@ -740,13 +748,14 @@ int amdgpu_mes_remove_hw_queue(struct amdgpu_device *adev, int queue_id)
 	struct amdgpu_mes_queue *queue;
 	struct amdgpu_mes_gang *gang;
 	struct mes_remove_queue_input queue_input;
+	struct amdgpu_mes_api_deferred deferred;
 	int r;
 
 	/*
 	 * Avoid taking any other locks under MES lock to avoid circular
 	 * lock dependencies.
 	 */
-	amdgpu_mes_lock(&adev->mes);
+	amdgpu_mes_lock_deferred(&adev->mes, &deferred);
 
 	/* remove the mes gang from idr list */
 	spin_lock_irqsave(&adev->mes.queue_id_lock, flags);
@@ -754,7 +763,7 @@ int amdgpu_mes_remove_hw_queue(struct amdgpu_device *adev, int queue_id)
 	queue = idr_find(&adev->mes.queue_id_idr, queue_id);
 	if (!queue) {
 		spin_unlock_irqrestore(&adev->mes.queue_id_lock, flags);
-		amdgpu_mes_unlock(&adev->mes);
+		amdgpu_mes_unlock_deferred(&adev->mes, &deferred);
 		DRM_ERROR("queue id %d doesn't exist\n", queue_id);
 		return -EINVAL;
 	}
@@ -770,13 +779,12 @@ int amdgpu_mes_remove_hw_queue(struct amdgpu_device *adev, int queue_id)
 	queue_input.gang_context_addr = gang->gang_ctx_gpu_addr;
 
 	r = adev->mes.funcs->remove_hw_queue(&adev->mes, &queue_input);
-	if (r)
-		DRM_ERROR("failed to remove hardware queue, queue id = %d\n",
-			  queue_id);
 
 	list_del(&queue->list);
 	amdgpu_mes_kernel_doorbell_free(adev, queue->doorbell_off);
-	amdgpu_mes_unlock(&adev->mes);
+	if (amdgpu_mes_unlock_deferred(&adev->mes, &deferred) || r)
+		DRM_ERROR("failed to remove hardware queue, queue id = %d\n",
+			  queue_id);
 
 	amdgpu_mes_queue_free_mqd(queue);
 	kfree(queue);
@@ -1025,6 +1033,7 @@ int amdgpu_mes_set_shader_debugger(struct amdgpu_device *adev,
 				bool trap_en)
 {
 	struct mes_misc_op_input op_input = {0};
+	struct amdgpu_mes_api_deferred deferred;
 	int r;
 
 	if (!adev->mes.funcs->misc_op) {
@@ -1048,14 +1057,14 @@ int amdgpu_mes_set_shader_debugger(struct amdgpu_device *adev,
 			AMDGPU_MES_API_VERSION_SHIFT) >= 14)
 		op_input.set_shader_debugger.trap_en = trap_en;
 
-	amdgpu_mes_lock(&adev->mes);
+	amdgpu_mes_lock_deferred(&adev->mes, &deferred);
 
 	r = adev->mes.funcs->misc_op(&adev->mes, &op_input);
+	if (amdgpu_mes_unlock_deferred(&adev->mes, &deferred))
+		r = -ETIMEDOUT;
 	if (r)
 		DRM_ERROR("failed to set_shader_debugger\n");
 
-	amdgpu_mes_unlock(&adev->mes);
-
 	return r;
 }
 
@@ -1063,6 +1072,7 @@ int amdgpu_mes_flush_shader_debugger(struct amdgpu_device *adev,
 				     uint64_t process_context_addr)
 {
 	struct mes_misc_op_input op_input = {0};
+	struct amdgpu_mes_api_deferred deferred;
 	int r;
 
 	if (!adev->mes.funcs->misc_op) {
@@ -1074,14 +1084,14 @@ int amdgpu_mes_flush_shader_debugger(struct amdgpu_device *adev,
 	op_input.set_shader_debugger.process_context_addr = process_context_addr;
 	op_input.set_shader_debugger.flags.process_ctx_flush = true;
 
-	amdgpu_mes_lock(&adev->mes);
+	amdgpu_mes_lock_deferred(&adev->mes, &deferred);
 
 	r = adev->mes.funcs->misc_op(&adev->mes, &op_input);
+	if (amdgpu_mes_unlock_deferred(&adev->mes, &deferred))
+		r = -ETIMEDOUT;
 	if (r)
 		DRM_ERROR("failed to set_shader_debugger\n");
 
-	amdgpu_mes_unlock(&adev->mes);
-
 	return r;
 }
 
@@ -1676,8 +1686,222 @@ bool amdgpu_mes_suspend_resume_all_supported(struct amdgpu_device *adev)
 	return is_supported;
 }
 
+/**
+ * amdgpu_mes_api_submitted - account an API packet emitted to a MES ring
+ * @mes: MES instance
+ *
+ * Returns the submission time to hand to amdgpu_mes_api_wait() or
+ * amdgpu_mes_api_defer().
+ */
+ktime_t amdgpu_mes_api_submitted(struct amdgpu_mes *mes)
+{
+	struct amdgpu_mes_api_stats *stats = &mes->api_stats;
+	int inflight = atomic_inc_return(&stats->inflight);
+	int max = atomic_read(&stats->inflight_max);
+
+	atomic64_inc(&stats->submits);
+	while (inflight > max &&
+	       !atomic_try_cmpxchg(&stats->inflight_max, &max, inflight))
+		;
+
+	return ktime_get();
+}
+
+static void amdgpu_mes_api_completed(struct amdgpu_mes *mes,
+				     ktime_t submitted)
+{
+	struct amdgpu_mes_api_stats *stats = &mes->api_stats;
+	s64 ns = ktime_to_ns(ktime_sub(ktime_get(), submitted));
+	s64 max = atomic64_read(&stats->latency_max_ns);
+
+	atomic_dec(&stats->inflight);
+	atomic64_add(ns, &stats->latency_ns);
+	while (ns > max &&
+	       !atomic64_try_cmpxchg(&stats->latency_max_ns, &max, ns))
+		;
+}
+
+/**
+ * amdgpu_mes_api_wait - wait for MES to process an API packet
+ * @mes: MES instance
+ * @ring: MES ring the packet was emitted to
+ * @seq: ring fence sequence emitted behind the packet
+ * @timeout: timeout in us
+ * @submitted: submission time from amdgpu_mes_api_submitted()
+ *
+ * The MES rings have no fence interrupt, so completion has to be polled.
+ * Callers may hold the MES lock or run in atomic context, e.g. for register
+ * access through MES, so this busy polls. Callers which can sleep and don't
+ * need the result under the MES lock use amdgpu_mes_lock_deferred() instead.
+ *
+ * Returns the remaining timeout in us, 0 if the wait timed out.
+ */
+signed long amdgpu_mes_api_wait(struct amdgpu_mes *mes,
+				struct amdgpu_ring *ring, uint32_t seq,
+				signed long timeout, ktime_t submitted)
+{
+	signed long r;
+
+	r = amdgpu_fence_wait_polling(ring, seq, timeout);
+	amdgpu_mes_api_completed(mes, submitted);
+	return r;
+}
+
+/*
+ * Wait for deferred API packets after the MES lock was dropped. Most packets
+ * are acknowledged within a few microseconds, so spin for
+ * AMDGPU_MES_API_POLL_US first and sleep between checks after that.
+ */
+static signed long amdgpu_mes_api_wait_sleep(struct amdgpu_mes *mes,
+					     struct amdgpu_ring *ring,
+					     uint32_t seq, signed long timeout)
+{
+	signed long spin = min_t(signed long, timeout, AMDGPU_MES_API_POLL_US);
+	ktime_t deadline;
+	signed long r;
+
+	might_sleep();
+
+	r = amdgpu_fence_wait_polling(ring, seq, spin);
+	if (r > 0)
+		return r + timeout - spin;
+
+	atomic64_inc(&mes->api_stats.sleeps);
+	deadline = ktime_add_us(ktime_get(), timeout - spin);
+	do {
+		usleep_range(10, 50);
+		if (amdgpu_fence_wait_polling(ring, seq, 2) > 0)
+			return max_t(s64, ktime_us_delta(deadline, ktime_get()), 1);
+	} while (ktime_before(ktime_get(), deadline));
+
+	return 0;
+}
+
+/**
+ * amdgpu_mes_api_defer - defer the completion wait of an API packet
+ * @mes: MES instance
+ * @ring: MES ring the packet was emitted to
+ * @seq: ring fence sequence emitted behind the packet
+ * @status_offset: writeback slot of the packet's API status
+ * @timeout: timeout in us
+ * @submitted: submission time from amdgpu_mes_api_submitted()
+ *
+ * Returns true if the calling task took the MES lock with
+ * amdgpu_mes_lock_deferred() and the packet is waited for when it drops the
+ * lock, the submitter must not wait for it then.
+ */
+bool amdgpu_mes_api_defer(struct amdgpu_mes *mes, struct amdgpu_ring *ring,
+			  uint32_t seq, uint32_t status_offset,
+			  signed long timeout, ktime_t submitted)
+{
+	struct amdgpu_mes_api_deferred *deferred;
+
+	if (READ_ONCE(mes->deferred_owner) != current)
+		return false;
+
+	/* MES processes each ring in order, the last fence has to cover all */
+	deferred = mes->deferred;
+	if (deferred->count == AMDGPU_MES_API_DEFER_MAX ||
+	    (deferred->count && deferred->ring != ring))
+		return false;
+
+	deferred->ring = ring;
+	deferred->timeout = timeout;
+	deferred->last_seq = seq;
+	deferred->status_offs[deferred->count] = status_offset;
+	deferred->submitted[deferred->count++] = submitted;
+	atomic64_inc(&mes->api_stats.deferred);
+	return true;
+}
+
+/**
+ * amdgpu_mes_lock_deferred - take the MES lock and defer API completion waits
+ * @mes: MES instance
+ * @deferred: storage for the deferred waits, usually on the caller's stack
+ *
+ * API packets the caller submits until amdgpu_mes_unlock_deferred() return
+ * as soon as they are emitted. Their completion is waited for after the MES
+ * lock is dropped, so other MES users don't queue up behind a slow
+ * acknowledgment and the wait can sleep. Only for callers which can sleep
+ * and don't need the result of a packet while holding the lock.
+ */
+void amdgpu_mes_lock_deferred(struct amdgpu_mes *mes,
+			      struct amdgpu_mes_api_deferred *deferred)
+{
+	amdgpu_mes_lock(mes);
+	deferred->count = 0;
+	mes->deferred = deferred;
+	WRITE_ONCE(mes->deferred_owner, current);
+}
+
+/**
+ * amdgpu_mes_unlock_deferred - drop the MES lock and wait for deferred packets
+ * @mes: MES instance
+ * @deferred: the deferred waits passed to amdgpu_mes_lock_deferred()
+ *
+ * Returns 0 if MES processed all deferred packets successfully, -ETIMEDOUT
+ * otherwise.
+ */
+int amdgpu_mes_unlock_deferred(struct amdgpu_mes *mes,
+			       struct amdgpu_mes_api_deferred *deferred)
+{
+	struct amdgpu_device *adev = mes->adev;
+	unsigned int i, failed = 0;
+	signed long r;
+
+	WRITE_ONCE(mes->deferred_owner, NULL);
+	mes->deferred = NULL;
+	amdgpu_mes_unlock(mes);
+
+	if (!deferred->count)
+		return 0;
+
+	r = amdgpu_mes_api_wait_sleep(mes, deferred->ring, deferred->last_seq,
+				      deferred->timeout);
+	for (i = 0; i < deferred->count; i++) {
+		u64 *status_ptr = (u64 *)&adev->wb.wb[deferred->status_offs[i]];
+
+		if (r < 1 || !*status_ptr)
+			failed++;
+		amdgpu_device_wb_free(adev, deferred->status_offs[i]);
+		amdgpu_mes_api_completed(mes, deferred->submitted[i]);
+	}
+
+	if (failed) {
+		dev_err(adev->dev, "MES failed to respond to %u deferred msgs\n",
+			failed);
+		while (halt_if_hws_hang)
+			schedule();
+		return -ETIMEDOUT;
+	}
+	return 0;
+}
+
 #if defined(CONFIG_DEBUG_FS)
 
+static int amdgpu_debugfs_mes_api_stats_show(struct seq_file *m, void *unused)
+{
+	struct amdgpu_device *adev = m->private;
+	struct amdgpu_mes_api_stats *stats = &adev->mes.api_stats;
+	u64 submits = atomic64_read(&stats->submits);
+	u64 ns = atomic64_read(&stats->latency_ns);
+
+	seq_printf(m, "submits: %llu deferred: %lld sleeping waits: %lld\n",
+		   submits, atomic64_read(&stats->deferred),
+		   atomic64_read(&stats->sleeps));
+	seq_printf(m, "latency avg: %llu us max: %llu us\n",
+		   submits ? div_u64(div64_u64(ns, submits), NSEC_PER_USEC) : 0,
+		   div_u64(atomic64_read(&stats->latency_max_ns),
+			   NSEC_PER_USEC));
+	seq_printf(m, "in flight: %d max: %d\n",
+		   atomic_read(&stats->inflight),
+		   atomic_read(&stats->inflight_max));
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(amdgpu_debugfs_mes_api_stats);
+
 static int amdgpu_debugfs_mes_event_log_show(struct seq_file *m, void *unused)
 {
 	struct amdgpu_device *adev = m->private;
@@ -1702,6 +1926,9 @@ void amdgpu_debugfs_mes_event_log_init(struct amdgpu_device *adev)
 	if (adev->enable_mes && amdgpu_mes_log_enable)
 		debugfs_create_file("amdgpu_mes_event_log", 0444, root,
 				    adev, &amdgpu_debugfs_mes_event_log_fops);
+	if (adev->enable_mes)
+		debugfs_create_file("amdgpu_mes_api_stats", 0444, root,
+				    adev, &amdgpu_debugfs_mes_api_stats_fops);
 
 #endif
 }
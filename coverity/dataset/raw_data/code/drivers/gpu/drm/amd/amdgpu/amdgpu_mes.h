@@ -50,11 +50,36 @@ enum amdgpu_mes_priority_level {
 	AMDGPU_MES_PRIORITY_NUM_LEVELS
 };
 
+/* API packets one MES lock holder may leave to amdgpu_mes_unlock_deferred() */
+#define AMDGPU_MES_API_DEFER_MAX	16
+/* busy poll for a deferred API completion this long before sleeping, in us */
+#define AMDGPU_MES_API_POLL_US		50
+
 #define AMDGPU_MES_PROC_CTX_SIZE 0x1000 /* one page area */
 #define AMDGPU_MES_GANG_CTX_SIZE 0x1000 /* one page area */
 
 struct amdgpu_mes_funcs;
 
+/* API packets whose completion is waited for after dropping the MES lock */
+struct amdgpu_mes_api_deferred {
+	struct amdgpu_ring		*ring;
+	signed long			timeout;
+	uint32_t			last_seq;
+	uint32_t			count;
+	uint32_t			status_offs[AMDGPU_MES_API_DEFER_MAX];
+	ktime_t				submitted[AMDGPU_MES_API_DEFER_MAX];
+};
+
+struct amdgpu_mes_api_stats {
+	atomic64_t			submits;
+	atomic64_t			deferred;
+	atomic64_t			sleeps;
+	atomic64_t			latency_ns;
+	atomic64_t			latency_max_ns;
+	atomic_t			inflight;
+	atomic_t			inflight_max;
+};
+
 enum admgpu_mes_pipe {
 	AMDGPU_MES_SCHED_PIPE = 0,
 	AMDGPU_MES_KIQ_PIPE,
@@ -124,6 +149,10 @@ struct amdgpu_mes {
 	uint32_t			*read_val_ptr;
 
 	uint32_t			saved_flags;
+	/* MES lock holder deferring its API waits, see amdgpu_mes_lock_deferred() */
+	struct task_struct		*deferred_owner;
+	struct amdgpu_mes_api_deferred	*deferred;
+	struct amdgpu_mes_api_stats	api_stats;
 
 	/* initialize kiq pipe */
 	int                             (*kiq_hw_init)(struct amdgpu_device *adev);
@@ -518,4 +547,16 @@ static inline void amdgpu_mes_unlock(struct amdgpu_mes *mes)
 }
 
 bool amdgpu_mes_suspend_resume_all_supported(struct amdgpu_device *adev);
+
+ktime_t amdgpu_mes_api_submitted(struct amdgpu_mes *mes);
+signed long amdgpu_mes_api_wait(struct amdgpu_mes *mes,
+				struct amdgpu_ring *ring, uint32_t seq,
+				signed long timeout, ktime_t submitted);
+bool amdgpu_mes_api_defer(struct amdgpu_mes *mes, struct amdgpu_ring *ring,
+			  uint32_t seq, uint32_t status_offset,
+			  signed long timeout, ktime_t submitted);
+void amdgpu_mes_lock_deferred(struct amdgpu_mes *mes,
+			      struct amdgpu_mes_api_deferred *deferred);
+int amdgpu_mes_unlock_deferred(struct amdgpu_mes *mes,
+			       struct amdgpu_mes_api_deferred *deferred);
 #endif /* __AMDGPU_MES_H__ */
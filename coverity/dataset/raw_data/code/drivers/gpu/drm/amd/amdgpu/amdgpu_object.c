@@ -39,6 +39,7 @@
 #include "amdgpu.h"
 #include "amdgpu_trace.h"
 #include "amdgpu_amdkfd.h"
+#include "amdgpu_dma_buf.h"
 #include "amdgpu_vram_mgr.h"
 
 /**
@@ -744,28 +745,42 @@ void amdgpu_bo_add_to_shadow_list(struct amdgpu_bo_vm *vmbo)
  * amdgpu_bo_restore_shadow - restore an &amdgpu_bo shadow
  *
  * @shadow: &amdgpu_bo shadow to be restored
- * @fence: dma_fence associated with the operation
+ * @ib: IB to emit the copy into, NULL to only calculate its size
  *
- * Copies a buffer object's shadow content back to the object.
+ * Emits the copy of a buffer object's shadow content back to the object.
  * This is used for recovering a buffer from its shadow in case of a gpu
- * reset where vram context may be lost.
+ * reset where vram context may be lost. The caller batches the copies of
+ * many shadows into a single IB.
  *
  * Returns:
- * 0 for success or a negative error code on failure.
+ * Number of dwords the copy needs in the IB.
  */
-int amdgpu_bo_restore_shadow(struct amdgpu_bo *shadow, struct dma_fence **fence)
-
+unsigned int amdgpu_bo_restore_shadow(struct amdgpu_bo *shadow,
+				      struct amdgpu_ib *ib)
 {
 	struct amdgpu_device *adev = amdgpu_ttm_adev(shadow->tbo.bdev);
-	struct amdgpu_ring *ring = adev->mman.buffer_funcs_ring;
-	uint64_t shadow_addr, parent_addr;
+	uint32_t max_bytes = adev->mman.buffer_funcs->copy_max_bytes;
+	uint64_t shadow_addr, parent_addr, size;
+	unsigned int num_loops;
+	uint32_t cur_size;
+
+	size = amdgpu_bo_size(shadow);
+	num_loops = DIV_ROUND_UP(size, max_bytes);
+	if (!ib)
+		return num_loops * adev->mman.buffer_funcs->copy_num_dw;
 
 	shadow_addr = amdgpu_bo_gpu_offset(shadow);
 	parent_addr = amdgpu_bo_gpu_offset(shadow->parent);
+	while (size) {
+		cur_size = min_t(uint64_t, size, max_bytes);
+		amdgpu_emit_copy_buffer(adev, ib, shadow_addr, parent_addr,
+					cur_size, 0);
+		shadow_addr += cur_size;
+		parent_addr += cur_size;
+		size -= cur_size;
+	}
 
-	return amdgpu_copy_buffer(ring, shadow_addr, parent_addr,
-				  amdgpu_bo_size(shadow), NULL, fence,
-				  true, false, 0);
+	return num_loops * adev->mman.buffer_funcs->copy_num_dw;
 }
 
 /**
@@ -1271,12 +1286,15 @@ void amdgpu_bo_move_notify(struct ttm_buffer_object *bo,
 
 	abo = ttm_to_amdgpu_bo(bo);
 	amdgpu_vm_bo_invalidate(adev, abo, evict);
+	++abo->move_seq;
 
 	amdgpu_bo_kunmap(abo);
 
 	if (abo->tbo.base.dma_buf && !abo->tbo.base.import_attach &&
-	    old_mem && old_mem->mem_type != TTM_PL_SYSTEM)
+	    old_mem && old_mem->mem_type != TTM_PL_SYSTEM) {
+		amdgpu_dma_buf_invalidate_sgt(abo);
 		dma_buf_move_notify(abo->tbo.base.dma_buf);
+	}
 
 	/* move_notify is called before move happens */
 	trace_amdgpu_bo_move(abo, new_mem ? new_mem->mem_type : -1,
@@ -1386,32 +1404,51 @@ void amdgpu_bo_release_notify(struct ttm_buffer_object *bo)
 /**
  * amdgpu_bo_fault_reserve_notify - notification about a memory fault
  * @bo: pointer to a buffer object
+ * @page_offset: page of the BO the fault is on
+ * @num_prefault: in: number of pages to map from @page_offset,
+ *                out: number of pages which may be mapped
  *
  * Notifies the driver we are taking a fault on this BO and have reserved it,
  * also performs bookkeeping.
  * TTM driver callback for dealing with vm faults.
  *
+ * When the BO is only partially CPU visible but the faulting page is, only
+ * the visible pages from there on are mapped and the BO stays where it is.
+ * Only a fault on an invisible page moves the BO.
+ *
  * Returns:
  * 0 for success or a negative error code on failure.
  */
-vm_fault_t amdgpu_bo_fault_reserve_notify(struct ttm_buffer_object *bo)
+vm_fault_t amdgpu_bo_fault_reserve_notify(struct ttm_buffer_object *bo,
+					  pgoff_t page_offset,
+					  pgoff_t *num_prefault)
 {
 	struct amdgpu_device *adev = amdgpu_ttm_adev(bo->bdev);
 	struct ttm_operation_ctx ctx = { false, false };
 	struct amdgpu_bo *abo = ttm_to_amdgpu_bo(bo);
+	pgoff_t pages;
 	int r;
 
-	/* Remember that this BO was accessed by the CPU */
-	abo->flags |= AMDGPU_GEM_CREATE_CPU_ACCESS_REQUIRED;
+	if (amdgpu_res_cpu_visible(adev, bo->resource)) {
+		/* Remember that this BO was accessed by the CPU */
+		abo->flags |= AMDGPU_GEM_CREATE_CPU_ACCESS_REQUIRED;
+		return 0;
+	}
 
-	if (amdgpu_res_cpu_visible(adev, bo->resource))
+	pages = amdgpu_res_cpu_visible_pages(adev, bo->resource, page_offset,
+					     *num_prefault);
+	if (pages) {
+		atomic64_inc(&adev->num_vram_cpu_window_faults);
+		*num_prefault = pages;
 		return 0;
+	}
 
 	/* Can't move a pinned BO to visible VRAM */
 	if (abo->tbo.pin_count > 0)
 		return VM_FAULT_SIGBUS;
 
 	/* hurrah the memory is not visible ! */
+	abo->flags |= AMDGPU_GEM_CREATE_CPU_ACCESS_REQUIRED;
 	atomic64_inc(&adev->num_vram_cpu_page_faults);
 	amdgpu_bo_placement_from_domain(abo, AMDGPU_GEM_DOMAIN_VRAM |
 					AMDGPU_GEM_DOMAIN_GTT);
@@ -1430,6 +1467,8 @@ vm_fault_t amdgpu_bo_fault_reserve_notify(struct ttm_buffer_object *bo)
 	    !amdgpu_res_cpu_visible(adev, bo->resource))
 		return VM_FAULT_SIGBUS;
 
+	/* Only count what was actually moved, not retries or failures */
+	atomic64_add(bo->base.size, &adev->num_vram_cpu_fault_bytes);
 	ttm_bo_move_to_lru_tail_unlocked(bo);
 	return 0;
 }
@@ -116,6 +116,8 @@ struct amdgpu_bo {
 	struct mmu_interval_notifier	notifier;
 #endif
 	struct kgd_mem                  *kfd_bo;
+	/* Incremented on every move, protected by tbo.reserved */
+	u64				move_seq;
 
 	/*
 	 * For GPUs with spatial partitioning, xcp partition number, -1 means
@@ -138,6 +140,10 @@ struct amdgpu_bo_vm {
 	struct amdgpu_bo		bo;
 	struct amdgpu_bo		*shadow;
 	struct list_head		shadow_list;
+	/* entry in the VM's list of freed PTs */
+	struct list_head		pt_cache;
+	/* last use of a freed PT, it can't be reused before this signals */
+	struct dma_fence		*pt_cache_fence;
 	struct amdgpu_vm_bo_base        entries[];
 };
 
@@ -338,7 +344,9 @@ void amdgpu_bo_move_notify(struct ttm_buffer_object *bo,
 			   bool evict,
 			   struct ttm_resource *new_mem);
 void amdgpu_bo_release_notify(struct ttm_buffer_object *bo);
-vm_fault_t amdgpu_bo_fault_reserve_notify(struct ttm_buffer_object *bo);
+vm_fault_t amdgpu_bo_fault_reserve_notify(struct ttm_buffer_object *bo,
+					  pgoff_t page_offset,
+					  pgoff_t *num_prefault);
 void amdgpu_bo_fence(struct amdgpu_bo *bo, struct dma_fence *fence,
 		     bool shared);
 int amdgpu_bo_sync_wait_resv(struct amdgpu_device *adev, struct dma_resv *resv,
@@ -350,8 +358,8 @@ u64 amdgpu_bo_gpu_offset_no_check(struct amdgpu_bo *bo);
 void amdgpu_bo_get_memory(struct amdgpu_bo *bo,
 			  struct amdgpu_mem_stats *stats);
 void amdgpu_bo_add_to_shadow_list(struct amdgpu_bo_vm *vmbo);
-int amdgpu_bo_restore_shadow(struct amdgpu_bo *shadow,
-			     struct dma_fence **fence);
+unsigned int amdgpu_bo_restore_shadow(struct amdgpu_bo *shadow,
+				      struct amdgpu_ib *ib);
 uint32_t amdgpu_bo_get_preferred_domain(struct amdgpu_device *adev,
 					    uint32_t domain);
 
@@ -43,6 +43,7 @@
 #include "amdgpu_ras.h"
 #include "amdgpu_securedisplay.h"
 #include "amdgpu_atomfirmware.h"
+#include "amdgpu_trace.h"
 
 #define AMD_VBIOS_FILE_MAX_SIZE_B      (1024*1024*3)
 
@@ -62,7 +63,7 @@ static int psp_ring_init(struct psp_context *psp,
 	ring->ring_type = ring_type;
 
 	/* allocate 4k Page of Local Frame Buffer memory for ring */
-	ring->ring_size = 0x1000;
+	ring->ring_size = PSP_KM_RING_SIZE;
 	ret = amdgpu_bo_create_kernel(adev, ring->ring_size, PAGE_SIZE,
 				      AMDGPU_GEM_DOMAIN_VRAM |
 				      AMDGPU_GEM_DOMAIN_GTT,
@@ -644,10 +645,9 @@ static const char *psp_gfx_cmd_name(enum psp_gfx_cmd_id cmd_id)
 	}
 }
 
-static bool psp_err_warn(struct psp_context *psp)
+static bool psp_err_warn(struct psp_context *psp,
+			 struct psp_gfx_cmd_resp *cmd)
 {
-	struct psp_gfx_cmd_resp *cmd = psp->cmd_buf_mem;
-
 	/* This response indicates reg list is already loaded */
 	if (amdgpu_ip_version(psp->adev, MP0_HWIP, 0) == IP_VERSION(13, 0, 2) &&
 	    cmd->cmd_id == GFX_CMD_ID_LOAD_IP_FW &&
@@ -658,33 +658,19 @@ static bool psp_err_warn(struct psp_context *psp)
 	return true;
 }
 
-static int
-psp_cmd_submit_buf(struct psp_context *psp,
-		   struct amdgpu_firmware_info *ucode,
-		   struct psp_gfx_cmd_resp *cmd, uint64_t fence_mc_addr)
+/*
+ * Wait until the PSP has written a fence value at or past @index.
+ *
+ * The KM ring is processed in order and the PSP writes the fence of each
+ * frame as it completes, so with several commands in flight the fence may
+ * skip over @index between two polls. Returns the remaining poll budget,
+ * zero on timeout.
+ */
+static int psp_cmd_wait_fence(struct psp_context *psp, int index,
+			      int timeout, bool *ras_intr)
 {
-	int ret;
-	int index;
-	int timeout = psp->adev->psp_timeout;
-	bool ras_intr = false;
-	bool skip_unsupport = false;
-
-	if (psp->adev->no_hw_access)
-		return 0;
-
-	memset(psp->cmd_buf_mem, 0, PSP_CMD_BUFFER_SIZE);
-
-	memcpy(psp->cmd_buf_mem, cmd, sizeof(struct psp_gfx_cmd_resp));
-
-	index = atomic_inc_return(&psp->fence_value);
-	ret = psp_ring_cmd_submit(psp, psp->cmd_buf_mc_addr, fence_mc_addr, index);
-	if (ret) {
-		atomic_dec(&psp->fence_value);
-		goto exit;
-	}
-
 	amdgpu_device_invalidate_hdp(psp->adev, NULL);
-	while (*((unsigned int *)psp->fence_buf) != index) {
+	while ((int)(READ_ONCE(*((unsigned int *)psp->fence_buf)) - index) < 0) {
 		if (--timeout == 0)
 			break;
 		/*
@@ -692,18 +678,26 @@ psp_cmd_submit_buf(struct psp_context *psp,
 		 * because gpu reset thread triggered and lock resource should
 		 * be released for psp resume sequence.
 		 */
-		ras_intr = amdgpu_ras_intr_triggered();
-		if (ras_intr)
+		*ras_intr = amdgpu_ras_intr_triggered();
+		if (*ras_intr)
 			break;
 		usleep_range(10, 100);
 		amdgpu_device_invalidate_hdp(psp->adev, NULL);
 	}
 
-	/* We allow TEE_ERROR_NOT_SUPPORTED for VMR command and PSP_ERR_UNKNOWN_COMMAND in SRIOV */
-	skip_unsupport = (psp->cmd_buf_mem->resp.status == TEE_ERROR_NOT_SUPPORTED ||
-		psp->cmd_buf_mem->resp.status == PSP_ERR_UNKNOWN_COMMAND) && amdgpu_sriov_vf(psp->adev);
+	return timeout;
+}
 
-	memcpy(&cmd->resp, &psp->cmd_buf_mem->resp, sizeof(struct psp_gfx_resp));
+static int psp_cmd_check_resp(struct psp_context *psp,
+			      struct amdgpu_firmware_info *ucode,
+			      struct psp_gfx_cmd_resp *cmd_buf,
+			      bool timed_out, bool ras_intr)
+{
+	bool skip_unsupport;
+
+	/* We allow TEE_ERROR_NOT_SUPPORTED for VMR command and PSP_ERR_UNKNOWN_COMMAND in SRIOV */
+	skip_unsupport = (cmd_buf->resp.status == TEE_ERROR_NOT_SUPPORTED ||
+		cmd_buf->resp.status == PSP_ERR_UNKNOWN_COMMAND) && amdgpu_sriov_vf(psp->adev);
 
 	/* In some cases, psp response status is not 0 even there is no
 	 * problem while the command is submitted. Some version of PSP FW
@@ -712,35 +706,68 @@ psp_cmd_submit_buf(struct psp_context *psp,
 	 * during psp initialization to avoid breaking hw_init and it doesn't
 	 * return -EINVAL.
 	 */
-	if (!skip_unsupport && (psp->cmd_buf_mem->resp.status || !timeout) && !ras_intr) {
+	if (!skip_unsupport && (cmd_buf->resp.status || timed_out) && !ras_intr) {
 		if (ucode)
 			dev_warn(psp->adev->dev,
 				 "failed to load ucode %s(0x%X) ",
 				 amdgpu_ucode_name(ucode->ucode_id), ucode->ucode_id);
-		if (psp_err_warn(psp))
+		if (psp_err_warn(psp, cmd_buf))
 			dev_warn(
 				psp->adev->dev,
 				"psp gfx command %s(0x%X) failed and response status is (0x%X)\n",
-				psp_gfx_cmd_name(psp->cmd_buf_mem->cmd_id),
-				psp->cmd_buf_mem->cmd_id,
-				psp->cmd_buf_mem->resp.status);
+				psp_gfx_cmd_name(cmd_buf->cmd_id),
+				cmd_buf->cmd_id,
+				cmd_buf->resp.status);
 		/* If any firmware (including CAP) load fails under SRIOV, it should
 		 * return failure to stop the VF from initializing.
 		 * Also return failure in case of timeout
 		 */
-		if ((ucode && amdgpu_sriov_vf(psp->adev)) || !timeout) {
-			ret = -EINVAL;
-			goto exit;
-		}
+		if ((ucode && amdgpu_sriov_vf(psp->adev)) || timed_out)
+			return -EINVAL;
 	}
 
 	if (ucode) {
-		ucode->tmr_mc_addr_lo = psp->cmd_buf_mem->resp.fw_addr_lo;
-		ucode->tmr_mc_addr_hi = psp->cmd_buf_mem->resp.fw_addr_hi;
+		ucode->tmr_mc_addr_lo = cmd_buf->resp.fw_addr_lo;
+		ucode->tmr_mc_addr_hi = cmd_buf->resp.fw_addr_hi;
 	}
 
-exit:
-	return ret;
+	return 0;
+}
+
+static int
+psp_cmd_submit_buf(struct psp_context *psp,
+		   struct amdgpu_firmware_info *ucode,
+		   struct psp_gfx_cmd_resp *cmd, uint64_t fence_mc_addr)
+{
+	int ret;
+	int index;
+	int timeout = psp->adev->psp_timeout;
+	bool ras_intr = false;
+	ktime_t start;
+
+	if (psp->adev->no_hw_access)
+		return 0;
+
+	/* The command structure spans the whole area the PSP reads */
+	memcpy(psp->cmd_buf_mem, cmd, sizeof(struct psp_gfx_cmd_resp));
+
+	start = ktime_get();
+	index = atomic_inc_return(&psp->fence_value);
+	ret = psp_ring_cmd_submit(psp, psp->cmd_buf_mc_addr, fence_mc_addr, index);
+	if (ret) {
+		atomic_dec(&psp->fence_value);
+		return ret;
+	}
+
+	timeout = psp_cmd_wait_fence(psp, index, timeout, &ras_intr);
+	trace_amdgpu_psp_cmd(psp->cmd_buf_mem->cmd_id, index,
+			     psp->cmd_buf_mem->resp.status,
+			     ktime_us_delta(ktime_get(), start));
+
+	memcpy(&cmd->resp, &psp->cmd_buf_mem->resp, sizeof(struct psp_gfx_resp));
+
+	return psp_cmd_check_resp(psp, ucode, psp->cmd_buf_mem, !timeout,
+				  ras_intr);
 }
 
 static struct psp_gfx_cmd_resp *acquire_psp_cmd_buf(struct psp_context *psp)
@@ -2696,6 +2723,108 @@ int psp_execute_ip_fw_load(struct psp_context *psp,
 	return ret;
 }
 
+/*
+ * Load several IP firmwares with one ring submission round trip.
+ *
+ * Each command gets its own slot in the cmd buffer so the frames can be
+ * queued on the KM ring back to back, see PSP_CMD_QUEUE_DEPTH; the PSP
+ * completes them in order and we only poll until the fence of each slot has
+ * been passed. Every slot gets the full PSP timeout, same as when the
+ * commands were sent one at a time.
+ *
+ * Like loading the ucodes one at a time, the first failure stops the load:
+ * nothing is submitted if a command can't be prepared, and after a failed
+ * submission only the frames already in flight are waited for. The first
+ * error is returned.
+ */
+static int psp_execute_ip_fw_load_batch(struct psp_context *psp,
+					struct amdgpu_firmware_info **ucodes,
+					int count)
+{
+	struct psp_gfx_cmd_resp *slot = psp->cmd_buf_mem;
+	int index[PSP_CMD_QUEUE_DEPTH];
+	bool ras_intr = false;
+	int i, queued, r, ret = 0;
+	bool timed_out;
+	ktime_t start;
+
+	if (WARN_ON(count > PSP_CMD_QUEUE_DEPTH))
+		return -EINVAL;
+
+	if (count == 1)
+		return psp_execute_ip_fw_load(psp, ucodes[0]);
+
+	if (psp->adev->no_hw_access)
+		return 0;
+
+	mutex_lock(&psp->mutex);
+
+	for (i = 0; i < count; ++i) {
+		memset(&slot[i], 0, sizeof(*slot));
+		ret = psp_prep_load_ip_fw_cmd_buf(psp, ucodes[i], &slot[i]);
+		if (ret) {
+			dev_err(psp->adev->dev, "failed to load ucode %s(0x%X)\n",
+				amdgpu_ucode_name(ucodes[i]->ucode_id),
+				ucodes[i]->ucode_id);
+			goto unlock;
+		}
+	}
+
+	start = ktime_get();
+	for (queued = 0; queued < count; ++queued) {
+		index[queued] = atomic_inc_return(&psp->fence_value);
+		r = psp_ring_cmd_submit(psp, psp->cmd_buf_mc_addr +
+					queued * sizeof(*slot),
+					psp->fence_buf_mc_addr, index[queued]);
+		if (r) {
+			atomic_dec(&psp->fence_value);
+			ret = r;
+			break;
+		}
+	}
+
+	for (i = 0; i < queued; ++i) {
+		timed_out = false;
+		if (!ras_intr)
+			timed_out = !psp_cmd_wait_fence(psp, index[i],
+							psp->adev->psp_timeout,
+							&ras_intr);
+		trace_amdgpu_psp_cmd(slot[i].cmd_id, index[i],
+				     slot[i].resp.status,
+				     ktime_us_delta(ktime_get(), start));
+
+		r = psp_cmd_check_resp(psp, ucodes[i], &slot[i], timed_out,
+				       ras_intr);
+		ret = ret ?: r;
+	}
+
+unlock:
+	mutex_unlock(&psp->mutex);
+	return ret;
+}
+
+static int psp_load_fw_batch_flush(struct psp_context *psp,
+				   struct amdgpu_firmware_info **batch,
+				   int *count)
+{
+	int ret = 0;
+
+	if (*count)
+		ret = psp_execute_ip_fw_load_batch(psp, batch, *count);
+	*count = 0;
+
+	return ret;
+}
+
+/*
+ * Queued loads are only used on bare metal, under SRIOV the host arbitrates
+ * the PSP and each failure has to be reported against its own ucode.
+ */
+static int psp_load_fw_batch_depth(struct psp_context *psp)
+{
+	return amdgpu_sriov_vf(psp->adev) ? 1 : PSP_CMD_QUEUE_DEPTH;
+}
+
 static int psp_load_p2s_table(struct psp_context *psp)
 {
 	int ret;
@@ -2789,13 +2918,14 @@ static bool fw_load_skip_check(struct psp_context *psp,
 int psp_load_fw_list(struct psp_context *psp,
 		     struct amdgpu_firmware_info **ucode_list, int ucode_count)
 {
-	int ret = 0, i;
-	struct amdgpu_firmware_info *ucode;
-
-	for (i = 0; i < ucode_count; ++i) {
-		ucode = ucode_list[i];
-		psp_print_fw_hdr(psp, ucode);
-		ret = psp_execute_ip_fw_load(psp, ucode);
+	int depth = psp_load_fw_batch_depth(psp);
+	int ret = 0, i, j, count;
+
+	for (i = 0; i < ucode_count; i += count) {
+		count = min(depth, ucode_count - i);
+		for (j = 0; j < count; ++j)
+			psp_print_fw_hdr(psp, ucode_list[i + j]);
+		ret = psp_execute_ip_fw_load_batch(psp, &ucode_list[i], count);
 		if (ret)
 			return ret;
 	}
@@ -2807,6 +2937,9 @@ static int psp_load_non_psp_fw(struct psp_context *psp)
 	int i, ret;
 	struct amdgpu_firmware_info *ucode;
 	struct amdgpu_device *adev = psp->adev;
+	struct amdgpu_firmware_info *batch[PSP_CMD_QUEUE_DEPTH];
+	int depth = psp_load_fw_batch_depth(psp);
+	int count = 0;
 
 	if (psp->autoload_supported &&
 	    !psp->pmfw_centralized_cstate_management) {
@@ -2823,6 +2956,9 @@ static int psp_load_non_psp_fw(struct psp_context *psp)
 
 		if (ucode->ucode_id == AMDGPU_UCODE_ID_SMC &&
 		    !fw_load_skip_check(psp, ucode)) {
+			ret = psp_load_fw_batch_flush(psp, batch, &count);
+			if (ret)
+				return ret;
 			ret = psp_load_smu_fw(psp);
 			if (ret)
 				return ret;
@@ -2849,22 +2985,28 @@ static int psp_load_non_psp_fw(struct psp_context *psp)
 
 		psp_print_fw_hdr(psp, ucode);
 
-		ret = psp_execute_ip_fw_load(psp, ucode);
-		if (ret)
-			return ret;
+		batch[count++] = ucode;
 
 		/* Start rlc autoload after psp recieved all the gfx firmware */
 		if (psp->autoload_supported && ucode->ucode_id == (amdgpu_sriov_vf(adev) ?
 		    adev->virt.autoload_ucode_id : AMDGPU_UCODE_ID_RLC_G)) {
+			ret = psp_load_fw_batch_flush(psp, batch, &count);
+			if (ret)
+				return ret;
+
 			ret = psp_rlc_autoload_start(psp);
 			if (ret) {
 				dev_err(adev->dev, "Failed to start rlc autoload\n");
 				return ret;
 			}
+		} else if (count == depth) {
+			ret = psp_load_fw_batch_flush(psp, batch, &count);
+			if (ret)
+				return ret;
 		}
 	}
 
-	return 0;
+	return psp_load_fw_batch_flush(psp, batch, &count);
 }
 
 static int psp_load_fw(struct amdgpu_device *adev)
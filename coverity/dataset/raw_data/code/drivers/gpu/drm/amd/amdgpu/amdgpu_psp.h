@@ -34,6 +34,18 @@
 
 #define PSP_FENCE_BUFFER_SIZE	0x1000
 #define PSP_CMD_BUFFER_SIZE	0x1000
+#define PSP_KM_RING_SIZE	0x1000
+/*
+ * Number of commands which may be in flight at once, one per cmd buffer slot.
+ * The GPCOM ring interface in psp_gfx_if.h bounds the queue only by the
+ * ring_buf_size handed to the PSP: it consumes psp_gfx_rb_frame entries in
+ * order through gpcom_rptr and writes the fence of each frame separately.
+ * The depth must stay below the number of ring frames, so the write pointer
+ * never wraps onto the read pointer.
+ */
+#define PSP_CMD_QUEUE_DEPTH	(PSP_CMD_BUFFER_SIZE / sizeof(struct psp_gfx_cmd_resp))
+static_assert(PSP_CMD_QUEUE_DEPTH <
+	      PSP_KM_RING_SIZE / sizeof(struct psp_gfx_rb_frame));
 #define PSP_1_MEG		0x100000
 #define PSP_TMR_SIZE(adev)	((adev)->asic_type == CHIP_ALDEBARAN ? 0x800000 : 0x400000)
 #define PSP_TMR_ALIGNMENT	0x100000
@@ -147,10 +147,25 @@ struct mce_notifier_adev_list {
 static struct mce_notifier_adev_list mce_adev_list;
 #endif
 
+static void amdgpu_ras_counter_cache_kick(struct amdgpu_ras *con)
+{
+	if (amdgpu_ras_cache_ms)
+		mod_delayed_work(system_wq, &con->counter_cache_work, 0);
+}
+
 void amdgpu_ras_set_error_query_ready(struct amdgpu_device *adev, bool ready)
 {
-	if (adev && amdgpu_ras_get_context(adev))
-		amdgpu_ras_get_context(adev)->error_query_ready = ready;
+	struct amdgpu_ras *con;
+
+	if (!adev || !amdgpu_ras_get_context(adev))
+		return;
+
+	con = amdgpu_ras_get_context(adev);
+	con->error_query_ready = ready;
+	if (ready)
+		amdgpu_ras_counter_cache_kick(con);
+	else if (amdgpu_ras_cache_ms)
+		cancel_delayed_work(&con->counter_cache_work);
 }
 
 static bool amdgpu_ras_get_error_query_ready(struct amdgpu_device *adev)
@@ -597,6 +612,122 @@ static const struct file_operations amdgpu_ras_debugfs_eeprom_ops = {
 	.llseek = default_llseek
 };
 
+/* ras counter cache */
+
+static bool amdgpu_ras_obj_has_counters(struct ras_manager *obj)
+{
+	if (amdgpu_aca_is_enabled(obj->adev))
+		return obj->aca_handle.mgr != NULL;
+
+	return obj->attr_inuse;
+}
+
+/* Query the counters of a block the way a read of its sysfs file does */
+static int amdgpu_ras_query_counters(struct ras_manager *obj,
+				     struct ras_query_if *info)
+{
+	struct amdgpu_device *adev = obj->adev;
+
+	info->head = obj->head;
+	if (amdgpu_ras_query_error_status(adev, info))
+		return -EINVAL;
+
+	/* the aca cache is cleared on query already */
+	if (amdgpu_aca_is_enabled(adev))
+		return 0;
+
+	if (amdgpu_ip_version(adev, MP0_HWIP, 0) != IP_VERSION(11, 0, 2) &&
+	    amdgpu_ip_version(adev, MP0_HWIP, 0) != IP_VERSION(11, 0, 4)) {
+		if (amdgpu_ras_reset_error_status(adev, info->head.block))
+			dev_warn(adev->dev, "Failed to reset error counter and error status");
+	}
+
+	return 0;
+}
+
+static int amdgpu_ras_counter_cache_update(struct ras_manager *obj)
+{
+	struct amdgpu_ras *con = amdgpu_ras_get_context(obj->adev);
+	struct ras_query_if info = {};
+	int r;
+
+	r = amdgpu_ras_query_counters(obj, &info);
+	if (r)
+		return r;
+
+	spin_lock(&con->counter_cache_lock);
+	obj->counter_cache = info;
+	obj->counter_cache_stamp = jiffies;
+	obj->counter_cache_valid = true;
+	spin_unlock(&con->counter_cache_lock);
+
+	return 0;
+}
+
+/**
+ * amdgpu_ras_read_counters - get the error counters of a block for a reader
+ * @obj: ras block
+ * @info: returns the counters
+ * @age_ms: returns how old the counters are
+ *
+ * Serves the counters from the cache when amdgpu_ras_cache_ms is set, and
+ * queries the hardware otherwise or when the cache wasn't filled yet.
+ *
+ * Returns 0 on success, -EBUSY if the counters can't be queried right now.
+ */
+static int amdgpu_ras_read_counters(struct ras_manager *obj,
+				    struct ras_query_if *info, u64 *age_ms)
+{
+	struct amdgpu_ras *con = amdgpu_ras_get_context(obj->adev);
+	bool ready = amdgpu_ras_get_error_query_ready(obj->adev);
+	int r;
+
+	*age_ms = 0;
+	if (!amdgpu_ras_cache_ms) {
+		if (!ready)
+			return -EBUSY;
+		return amdgpu_ras_query_counters(obj, info);
+	}
+
+	if (!READ_ONCE(obj->counter_cache_valid)) {
+		if (!ready)
+			return -EBUSY;
+		r = amdgpu_ras_counter_cache_update(obj);
+		if (r)
+			return r;
+	}
+
+	spin_lock(&con->counter_cache_lock);
+	*info = obj->counter_cache;
+	*age_ms = jiffies_to_msecs(jiffies - obj->counter_cache_stamp);
+	spin_unlock(&con->counter_cache_lock);
+
+	return 0;
+}
+
+static void amdgpu_ras_counter_cache_work(struct work_struct *work)
+{
+	struct amdgpu_ras *con = container_of(work, struct amdgpu_ras,
+					      counter_cache_work.work);
+	struct amdgpu_device *adev = con->adev;
+	struct ras_manager *obj;
+
+	/* kicked again once queries are possible */
+	if (!amdgpu_ras_get_error_query_ready(adev))
+		return;
+
+	/* don't wake up the device, readers see the age of the cache */
+	if (!adev->in_runpm) {
+		list_for_each_entry(obj, &con->head, node) {
+			if (amdgpu_ras_obj_has_counters(obj))
+				amdgpu_ras_counter_cache_update(obj);
+		}
+	}
+
+	schedule_delayed_work(&con->counter_cache_work,
+			      msecs_to_jiffies(amdgpu_ras_cache_ms));
+}
+
 /**
  * DOC: AMDGPU RAS sysfs Error Count Interface
  *
@@ -617,33 +748,35 @@ static const struct file_operations amdgpu_ras_debugfs_eeprom_ops = {
  *	ue: 0
  *	ce: 1
  *
+ * When the counters are cached (see the ras_cache_ms module parameter) an
+ * additional "age_ms: N" line reports how old they are.
+ *
  */
 static ssize_t amdgpu_ras_sysfs_read(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
 	struct ras_manager *obj = container_of(attr, struct ras_manager, sysfs_attr);
-	struct ras_query_if info = {
-		.head = obj->head,
-	};
+	struct ras_query_if info = {};
+	u64 age_ms;
+	int r, size;
 
-	if (!amdgpu_ras_get_error_query_ready(obj->adev))
+	r = amdgpu_ras_read_counters(obj, &info, &age_ms);
+	if (r == -EBUSY)
 		return sysfs_emit(buf, "Query currently inaccessible\n");
-
-	if (amdgpu_ras_query_error_status(obj->adev, &info))
+	if (r)
 		return -EINVAL;
 
-	if (amdgpu_ip_version(obj->adev, MP0_HWIP, 0) != IP_VERSION(11, 0, 2) &&
-	    amdgpu_ip_version(obj->adev, MP0_HWIP, 0) != IP_VERSION(11, 0, 4)) {
-		if (amdgpu_ras_reset_error_status(obj->adev, info.head.block))
-			dev_warn(obj->adev->dev, "Failed to reset error counter and error status");
-	}
-
 	if (info.head.block == AMDGPU_RAS_BLOCK__UMC)
-		return sysfs_emit(buf, "%s: %lu\n%s: %lu\n%s: %lu\n", "ue", info.ue_count,
+		size = sysfs_emit(buf, "%s: %lu\n%s: %lu\n%s: %lu\n", "ue", info.ue_count,
 				"ce", info.ce_count, "de", info.de_count);
 	else
-		return sysfs_emit(buf, "%s: %lu\n%s: %lu\n", "ue", info.ue_count,
+		size = sysfs_emit(buf, "%s: %lu\n%s: %lu\n", "ue", info.ue_count,
 				"ce", info.ce_count);
+
+	if (amdgpu_ras_cache_ms)
+		size += sysfs_emit_at(buf, size, "age_ms: %llu\n", age_ms);
+
+	return size;
 }
 
 /* obj begin */
@@ -1293,18 +1426,22 @@ ssize_t amdgpu_ras_aca_sysfs_read(struct device *dev, struct device_attribute *a
 				  struct aca_handle *handle, char *buf, void *data)
 {
 	struct ras_manager *obj = container_of(handle, struct ras_manager, aca_handle);
-	struct ras_query_if info = {
-		.head = obj->head,
-	};
+	struct ras_query_if info = {};
+	u64 age_ms;
+	int r, size;
 
-	if (!amdgpu_ras_get_error_query_ready(obj->adev))
+	r = amdgpu_ras_read_counters(obj, &info, &age_ms);
+	if (r == -EBUSY)
 		return sysfs_emit(buf, "Query currently inaccessible\n");
-
-	if (amdgpu_ras_query_error_status(obj->adev, &info))
+	if (r)
 		return -EINVAL;
 
-	return sysfs_emit(buf, "%s: %lu\n%s: %lu\n%s: %lu\n", "ue", info.ue_count,
+	size = sysfs_emit(buf, "%s: %lu\n%s: %lu\n%s: %lu\n", "ue", info.ue_count,
 			  "ce", info.ce_count, "de", info.de_count);
+	if (amdgpu_ras_cache_ms)
+		size += sysfs_emit_at(buf, size, "age_ms: %llu\n", age_ms);
+
+	return size;
 }
 
 static int amdgpu_ras_query_error_status_helper(struct amdgpu_device *adev,
@@ -1708,6 +1845,65 @@ static ssize_t amdgpu_ras_sysfs_badpages_read(struct file *f,
 	return s;
 }
 
+/**
+ * DOC: AMDGPU RAS sysfs error_counters Interface
+ *
+ * The error_counters binary file in the ras directory returns the error
+ * counters of all blocks in one read, as an array of
+ * struct amdgpu_ras_counter_entry in host byte order. Blocks whose counters
+ * can't be queried right now are left out. Like the per block files, reads
+ * are served from the counter cache when the ras_cache_ms module parameter
+ * is set.
+ */
+static ssize_t amdgpu_ras_sysfs_counters_read(struct file *f,
+		struct kobject *kobj, struct bin_attribute *attr,
+		char *buf, loff_t ppos, size_t count)
+{
+	struct amdgpu_ras *con =
+		container_of(attr, struct amdgpu_ras, counters_attr);
+	struct amdgpu_ras_counter_entry *entries;
+	struct ras_manager *obj;
+	unsigned int n = 0, max = 0;
+	ssize_t size;
+
+	list_for_each_entry(obj, &con->head, node)
+		max++;
+
+	entries = kcalloc(max, sizeof(*entries), GFP_KERNEL);
+	if (!entries)
+		return -ENOMEM;
+
+	list_for_each_entry(obj, &con->head, node) {
+		struct ras_query_if info = {};
+		u64 age_ms;
+
+		if (n == max)
+			break;
+		if (!amdgpu_ras_obj_has_counters(obj) ||
+		    amdgpu_ras_read_counters(obj, &info, &age_ms))
+			continue;
+
+		entries[n].block = obj->head.block;
+		entries[n].sub_block = obj->head.sub_block_index;
+		entries[n].ue_count = info.ue_count;
+		entries[n].ce_count = info.ce_count;
+		entries[n].de_count = info.de_count;
+		entries[n].age_ms = age_ms;
+		n++;
+	}
+
+	size = n * sizeof(*entries);
+	if (ppos >= size) {
+		size = 0;
+	} else {
+		size = min_t(ssize_t, count, size - ppos);
+		memcpy(buf, (char *)entries + ppos, size);
+	}
+
+	kfree(entries);
+	return size;
+}
+
 static ssize_t amdgpu_ras_sysfs_features_read(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -1776,6 +1972,16 @@ static void amdgpu_ras_sysfs_remove_bad_page_node(struct amdgpu_device *adev)
 				RAS_FS_NAME);
 }
 
+static void amdgpu_ras_sysfs_remove_counters_node(struct amdgpu_device *adev)
+{
+	struct amdgpu_ras *con = amdgpu_ras_get_context(adev);
+
+	if (adev->dev->kobj.sd)
+		sysfs_remove_file_from_group(&adev->dev->kobj,
+				&con->counters_attr.attr,
+				RAS_FS_NAME);
+}
+
 static int amdgpu_ras_sysfs_remove_dev_attr_node(struct amdgpu_device *adev)
 {
 	struct amdgpu_ras *con = amdgpu_ras_get_context(adev);
@@ -1867,6 +2073,7 @@ static int amdgpu_ras_sysfs_remove_all(struct amdgpu_device *adev)
 	if (amdgpu_bad_page_threshold != 0)
 		amdgpu_ras_sysfs_remove_bad_page_node(adev);
 
+	amdgpu_ras_sysfs_remove_counters_node(adev);
 	amdgpu_ras_sysfs_remove_dev_attr_node(adev);
 
 	return 0;
@@ -2010,6 +2217,8 @@ void amdgpu_ras_debugfs_create_all(struct amdgpu_device *adev)
 /* ras fs */
 static BIN_ATTR(gpu_vram_bad_pages, S_IRUGO,
 		amdgpu_ras_sysfs_badpages_read, NULL, 0);
+static BIN_ATTR(error_counters, 0444,
+		amdgpu_ras_sysfs_counters_read, NULL, 0);
 static DEVICE_ATTR(features, S_IRUGO,
 		amdgpu_ras_sysfs_features_read, NULL);
 static DEVICE_ATTR(version, 0444,
@@ -2034,8 +2243,9 @@ static int amdgpu_ras_fs_init(struct amdgpu_device *adev)
 	struct bin_attribute *bin_attrs[] = {
 		NULL,
 		NULL,
+		NULL,
 	};
-	int r;
+	int r, n = 0;
 
 	group.attrs = attrs;
 
@@ -2059,11 +2269,16 @@ static int amdgpu_ras_fs_init(struct amdgpu_device *adev)
 		/* add bad_page_features entry */
 		bin_attr_gpu_vram_bad_pages.private = NULL;
 		con->badpages_attr = bin_attr_gpu_vram_bad_pages;
-		bin_attrs[0] = &con->badpages_attr;
-		group.bin_attrs = bin_attrs;
-		sysfs_bin_attr_init(bin_attrs[0]);
+		bin_attrs[n] = &con->badpages_attr;
+		sysfs_bin_attr_init(bin_attrs[n++]);
 	}
 
+	/* add error_counters entry */
+	con->counters_attr = bin_attr_error_counters;
+	bin_attrs[n] = &con->counters_attr;
+	sysfs_bin_attr_init(bin_attrs[n++]);
+	group.bin_attrs = bin_attrs;
+
 	r = sysfs_create_group(&adev->dev->kobj, &group);
 	if (r)
 		dev_err(adev->dev, "Failed to create RAS sysfs group!");
@@ -2263,6 +2478,7 @@ static void amdgpu_ras_interrupt_process_handler(struct work_struct *work)
 		container_of(data, struct ras_manager, ih_data);
 
 	amdgpu_ras_interrupt_handler(obj);
+	amdgpu_ras_counter_cache_kick(amdgpu_ras_get_context(obj->adev));
 }
 
 int amdgpu_ras_interrupt_dispatch(struct amdgpu_device *adev,
@@ -2637,14 +2853,14 @@ static void amdgpu_ras_do_recovery(struct work_struct *work)
 	}
 }
 
-/* alloc/realloc bps array */
+/* alloc/realloc bps array, grows at least geometrically */
 static int amdgpu_ras_realloc_eh_data_space(struct amdgpu_device *adev,
 		struct ras_err_handler_data *data, int pages)
 {
 	unsigned int old_space = data->count + data->space_left;
-	unsigned int new_space = old_space + pages;
+	unsigned int new_space = old_space + max_t(unsigned int, pages, old_space);
 	unsigned int align_space = ALIGN(new_space, 512);
-	void *bps = kmalloc(align_space * sizeof(*data->bps), GFP_KERNEL);
+	void *bps = kvmalloc_array(align_space, sizeof(*data->bps), GFP_KERNEL);
 
 	if (!bps) {
 		return -ENOMEM;
@@ -2653,7 +2869,7 @@ static int amdgpu_ras_realloc_eh_data_space(struct amdgpu_device *adev,
 	if (data->bps) {
 		memcpy(bps, data->bps,
 				data->count * sizeof(*data->bps));
-		kfree(data->bps);
+		kvfree(data->bps);
 	}
 
 	data->bps = bps;
@@ -2678,16 +2894,23 @@ int amdgpu_ras_add_bad_pages(struct amdgpu_device *adev,
 	if (!data)
 		goto out;
 
+	/* make room for the whole batch at once */
+	if (data->space_left < pages &&
+	    amdgpu_ras_realloc_eh_data_space(adev, data,
+					     pages - data->space_left)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
 	for (i = 0; i < pages; i++) {
 		if (amdgpu_ras_check_bad_page_unlock(con,
 			bps[i].retired_page << AMDGPU_GPU_PAGE_SHIFT))
 			continue;
 
-		if (!data->space_left &&
-			amdgpu_ras_realloc_eh_data_space(adev, data, 256)) {
-			ret = -ENOMEM;
+		ret = xa_err(xa_store(&data->bps_index, bps[i].retired_page,
+				      xa_mk_value(data->count), GFP_KERNEL));
+		if (ret)
 			goto out;
-		}
 
 		amdgpu_ras_reserve_page(adev, bps[i].retired_page);
 
@@ -2778,14 +3001,9 @@ static bool amdgpu_ras_check_bad_page_unlock(struct amdgpu_ras *con,
 				uint64_t addr)
 {
 	struct ras_err_handler_data *data = con->eh_data;
-	int i;
 
 	addr >>= AMDGPU_GPU_PAGE_SHIFT;
-	for (i = 0; i < data->count; i++)
-		if (addr == data->bps[i].retired_page)
-			return true;
-
-	return false;
+	return xa_load(&data->bps_index, addr) != NULL;
 }
 
 /*
@@ -3172,6 +3390,7 @@ int amdgpu_ras_recovery_init(struct amdgpu_device *adev)
 		ret = -ENOMEM;
 		goto out;
 	}
+	xa_init(&(*data)->bps_index);
 
 	mutex_init(&con->recovery_lock);
 	INIT_WORK(&con->recovery_work, amdgpu_ras_do_recovery);
@@ -3231,7 +3450,8 @@ int amdgpu_ras_recovery_init(struct amdgpu_device *adev)
 	return 0;
 
 free:
-	kfree((*data)->bps);
+	xa_destroy(&(*data)->bps_index);
+	kvfree((*data)->bps);
 	kfree(*data);
 	con->eh_data = NULL;
 out:
@@ -3282,7 +3502,8 @@ static int amdgpu_ras_recovery_fini(struct amdgpu_device *adev)
 
 	mutex_lock(&con->recovery_lock);
 	con->eh_data = NULL;
-	kfree(data->bps);
+	xa_destroy(&data->bps_index);
+	kvfree(data->bps);
 	kfree(data);
 	mutex_unlock(&con->recovery_lock);
 
@@ -3574,6 +3795,8 @@ int amdgpu_ras_init(struct amdgpu_device *adev)
 
 	con->adev = adev;
 	INIT_DELAYED_WORK(&con->ras_counte_delay_work, amdgpu_ras_counte_dw);
+	INIT_DELAYED_WORK(&con->counter_cache_work, amdgpu_ras_counter_cache_work);
+	spin_lock_init(&con->counter_cache_lock);
 	atomic_set(&con->ras_ce_count, 0);
 	atomic_set(&con->ras_ue_count, 0);
 
@@ -3863,6 +4086,9 @@ void amdgpu_ras_resume(struct amdgpu_device *adev)
 			}
 		}
 	}
+
+	if (amdgpu_ras_get_error_query_ready(adev))
+		amdgpu_ras_counter_cache_kick(con);
 }
 
 void amdgpu_ras_suspend(struct amdgpu_device *adev)
@@ -3872,6 +4098,7 @@ void amdgpu_ras_suspend(struct amdgpu_device *adev)
 	if (!adev->ras_enabled || !con)
 		return;
 
+	cancel_delayed_work_sync(&con->counter_cache_work);
 	amdgpu_ras_disable_all_features(adev, 0);
 	/* Make sure all ras objects are disabled. */
 	if (AMDGPU_RAS_GET_FEATURES(con->features))
@@ -3940,6 +4167,7 @@ int amdgpu_ras_pre_fini(struct amdgpu_device *adev)
 	if (!adev->ras_enabled || !con)
 		return 0;
 
+	cancel_delayed_work_sync(&con->counter_cache_work);
 
 	/* Need disable ras on all IPs here before ip [hw/sw]fini */
 	if (AMDGPU_RAS_GET_FEATURES(con->features))
@@ -3988,6 +4216,7 @@ int amdgpu_ras_fini(struct amdgpu_device *adev)
 		amdgpu_ras_disable_all_features(adev, 0);
 
 	cancel_delayed_work_sync(&con->ras_counte_delay_work);
+	cancel_delayed_work_sync(&con->counter_cache_work);
 
 	amdgpu_ras_set_context(adev, NULL);
 	kfree(con);
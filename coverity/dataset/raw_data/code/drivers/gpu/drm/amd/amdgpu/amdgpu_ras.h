@@ -28,6 +28,7 @@
 #include <linux/list.h>
 #include <linux/kfifo.h>
 #include <linux/radix-tree.h>
+#include <linux/xarray.h>
 #include "ta_ras_if.h"
 #include "amdgpu_ras_eeprom.h"
 #include "amdgpu_smuio.h"
@@ -503,6 +504,7 @@ struct amdgpu_ras {
 	struct device_attribute schema_attr;
 	struct device_attribute event_state_attr;
 	struct bin_attribute badpages_attr;
+	struct bin_attribute counters_attr;
 	struct dentry *de_ras_eeprom_table;
 	/* block array */
 	struct ras_manager *objs;
@@ -535,6 +537,10 @@ struct amdgpu_ras {
 	atomic_t ras_ue_count;
 	atomic_t ras_ce_count;
 
+	/* per block error counters cache, see amdgpu_ras_cache_ms */
+	struct delayed_work counter_cache_work;
+	spinlock_t counter_cache_lock;
+
 	/* record umc error info queried from smu */
 	struct umc_ecc_info umc_ecc;
 
@@ -605,6 +611,8 @@ struct ras_err_handler_data {
 	int count;
 	/* the space can place new entries */
 	int space_left;
+	/* retired_page -> index into bps, for fast lookup */
+	struct xarray bps_index;
 };
 
 typedef int (*ras_ih_cb)(struct amdgpu_device *adev,
@@ -647,6 +655,22 @@ struct ras_manager {
 	struct ras_err_data err_data;
 
 	struct aca_handle aca_handle;
+
+	/* cached error counters, protected by amdgpu_ras.counter_cache_lock */
+	struct ras_query_if counter_cache;
+	unsigned long counter_cache_stamp;
+	bool counter_cache_valid;
+};
+
+/* one block in the ras/error_counters binary sysfs file */
+struct amdgpu_ras_counter_entry {
+	uint32_t block;
+	uint32_t sub_block;
+	uint64_t ue_count;
+	uint64_t ce_count;
+	uint64_t de_count;
+	/* age of the counters in ms, 0 when queried for this read */
+	uint64_t age_ms;
 };
 
 struct ras_badpage {
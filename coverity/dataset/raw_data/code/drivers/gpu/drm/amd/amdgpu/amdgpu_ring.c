@@ -108,10 +108,7 @@ int amdgpu_ring_alloc(struct amdgpu_ring *ring, unsigned int ndw)
  */
 void amdgpu_ring_insert_nop(struct amdgpu_ring *ring, uint32_t count)
 {
-	int i;
-
-	for (i = 0; i < count; i++)
-		amdgpu_ring_write(ring, ring->funcs->nop);
+	amdgpu_ring_write_fill(ring, ring->funcs->nop, count);
 }
 
 /**
@@ -124,8 +121,10 @@ void amdgpu_ring_insert_nop(struct amdgpu_ring *ring, uint32_t count)
  */
 void amdgpu_ring_generic_pad_ib(struct amdgpu_ring *ring, struct amdgpu_ib *ib)
 {
-	while (ib->length_dw & ring->funcs->align_mask)
-		ib->ptr[ib->length_dw++] = ring->funcs->nop;
+	uint32_t count = -ib->length_dw & ring->funcs->align_mask;
+
+	memset32(&ib->ptr[ib->length_dw], ring->funcs->nop, count);
+	ib->length_dw += count;
 }
 
 /**
@@ -181,6 +180,123 @@ void amdgpu_ring_undo(struct amdgpu_ring *ring)
 	 (void *)((uint8_t *)(ring->mes_ctx->meta_data_ptr) + offset) : \
 	 (&ring->adev->wb.wb[offset]))
 
+/* Take a progress sample of @ring, called with the hangcheck lock held */
+static enum amdgpu_ring_hang_reason
+amdgpu_ring_hangcheck_sample(struct amdgpu_ring *ring)
+{
+	struct amdgpu_ring_hangcheck *hc = &ring->hangcheck;
+	enum amdgpu_ring_hang_reason reason;
+	uint32_t seq;
+	u64 rptr;
+
+	amdgpu_fence_process(ring);
+	seq = atomic_read(&ring->fence_drv.last_seq);
+	rptr = amdgpu_ring_get_rptr(ring);
+
+	if (seq != hc->last_seq) {
+		reason = AMDGPU_RING_HANG_FENCE_PROGRESS;
+		hc->extensions = 0;
+		hc->last_progress = jiffies;
+	} else if (rptr != hc->last_rptr) {
+		reason = AMDGPU_RING_HANG_RPTR_PROGRESS;
+		hc->last_progress = jiffies;
+	} else {
+		reason = AMDGPU_RING_HANG_NO_PROGRESS;
+	}
+
+	hc->last_seq = seq;
+	hc->last_rptr = rptr;
+	hc->samples++;
+
+	return reason;
+}
+
+/*
+ * A ring with pending work which neither signaled a fence nor moved its read
+ * pointer for amdgpu_hang_stall_ms is considered hung and recovered without
+ * waiting for the lockup timeout. The threshold is separate from the lockup
+ * timeout, if it isn't below it the scheduler timeout comes first anyway.
+ */
+static void amdgpu_ring_hangcheck_work(struct work_struct *work)
+{
+	struct amdgpu_ring *ring = container_of(work, struct amdgpu_ring,
+						hangcheck.work.work);
+	struct amdgpu_ring_hangcheck *hc = &ring->hangcheck;
+	unsigned long stall = msecs_to_jiffies(amdgpu_hang_stall_ms);
+	bool fault = false;
+
+	mutex_lock(&hc->lock);
+	if (!amdgpu_ring_sched_ready(ring) || amdgpu_in_reset(ring->adev) ||
+	    atomic_read(&ring->fence_drv.last_seq) == ring->fence_drv.sync_seq) {
+		/* idle rings can't hang */
+		hc->last_progress = jiffies;
+	} else if (amdgpu_ring_hangcheck_sample(ring) ==
+		   AMDGPU_RING_HANG_NO_PROGRESS && stall &&
+		   stall < ring->sched.timeout &&
+		   time_after(jiffies, hc->last_progress + stall)) {
+		hc->last_progress = jiffies;
+		hc->watchdog_faults++;
+		hc->last_reason = AMDGPU_RING_HANG_WATCHDOG;
+		fault = true;
+	}
+	mutex_unlock(&hc->lock);
+
+	if (fault) {
+		dev_warn(ring->adev->dev, "ring %s made no progress for %u ms\n",
+			 ring->name, amdgpu_hang_stall_ms);
+		drm_sched_fault(&ring->sched);
+	}
+
+	schedule_delayed_work(&hc->work, msecs_to_jiffies(amdgpu_hang_watchdog));
+}
+
+/**
+ * amdgpu_ring_hangcheck - decide if a timed out ring is really hung
+ *
+ * @ring: ring whose scheduler timed out
+ * @fence: hardware fence of the timed out job
+ *
+ * Only called with the hang watchdog enabled. A job which signaled before
+ * we got here was not hung. The last watchdog sample is recent, so a ring
+ * which signaled fences or advanced its read pointer since then is still
+ * working and gets its deadline extended a limited number of times.
+ *
+ * Returns true if the ring should be recovered.
+ */
+bool amdgpu_ring_hangcheck(struct amdgpu_ring *ring, struct dma_fence *fence)
+{
+	struct amdgpu_ring_hangcheck *hc = &ring->hangcheck;
+	enum amdgpu_ring_hang_reason reason;
+	bool hung = true;
+
+	mutex_lock(&hc->lock);
+	reason = amdgpu_ring_hangcheck_sample(ring);
+
+	if (fence && dma_fence_is_signaled(fence)) {
+		reason = AMDGPU_RING_HANG_SIGNALED;
+		hc->spurious++;
+		hung = false;
+	} else if (reason == AMDGPU_RING_HANG_FENCE_PROGRESS ||
+		   reason == AMDGPU_RING_HANG_RPTR_PROGRESS) {
+		if (hc->extensions < AMDGPU_RING_HANGCHECK_MAX_EXTENSIONS) {
+			hc->extensions++;
+			hc->extended++;
+			hung = false;
+		} else {
+			reason = AMDGPU_RING_HANG_EXTEND_LIMIT;
+		}
+	}
+
+	if (hung) {
+		hc->extensions = 0;
+		hc->hangs++;
+	}
+	hc->last_reason = reason;
+	mutex_unlock(&hc->lock);
+
+	return hung;
+}
+
 /**
  * amdgpu_ring_init - init driver ring struct.
  *
@@ -236,6 +352,14 @@ int amdgpu_ring_init(struct amdgpu_device *adev, struct amdgpu_ring *ring,
 		r = amdgpu_fence_driver_init_ring(ring);
 		if (r)
 			return r;
+
+		mutex_init(&ring->hangcheck.lock);
+		INIT_DELAYED_WORK(&ring->hangcheck.work,
+				  amdgpu_ring_hangcheck_work);
+		ring->hangcheck.last_progress = jiffies;
+		if (amdgpu_hang_watchdog > 0 && !ring->no_scheduler)
+			schedule_delayed_work(&ring->hangcheck.work,
+					      msecs_to_jiffies(amdgpu_hang_watchdog));
 	}
 
 	if (ring->is_mes_queue) {
@@ -382,6 +506,7 @@ void amdgpu_ring_fini(struct amdgpu_ring *ring)
 		return;
 
 	ring->sched.ready = false;
+	cancel_delayed_work_sync(&ring->hangcheck.work);
 
 	if (!ring->is_mes_queue) {
 		amdgpu_device_wb_free(ring->adev, ring->rptr_offs);
@@ -600,6 +725,48 @@ static int amdgpu_debugfs_ring_error(void *data, u64 val)
 DEFINE_DEBUGFS_ATTRIBUTE_SIGNED(amdgpu_debugfs_error_fops, NULL,
 				amdgpu_debugfs_ring_error, "%lld\n");
 
+static const char *amdgpu_ring_hang_reason_name(enum amdgpu_ring_hang_reason reason)
+{
+	switch (reason) {
+	case AMDGPU_RING_HANG_FENCE_PROGRESS:
+		return "fence progress";
+	case AMDGPU_RING_HANG_RPTR_PROGRESS:
+		return "rptr progress";
+	case AMDGPU_RING_HANG_NO_PROGRESS:
+		return "no progress";
+	case AMDGPU_RING_HANG_SIGNALED:
+		return "signaled";
+	case AMDGPU_RING_HANG_EXTEND_LIMIT:
+		return "extension limit";
+	case AMDGPU_RING_HANG_WATCHDOG:
+		return "watchdog";
+	default:
+		return "none";
+	}
+}
+
+static int amdgpu_debugfs_hangcheck_show(struct seq_file *m, void *unused)
+{
+	struct amdgpu_ring *ring = m->private;
+	struct amdgpu_ring_hangcheck *hc = &ring->hangcheck;
+
+	mutex_lock(&hc->lock);
+	seq_printf(m, "samples: %llu\n", hc->samples);
+	seq_printf(m, "last seq: %u rptr: 0x%llx\n", hc->last_seq,
+		   hc->last_rptr);
+	seq_printf(m, "timeouts extended: %llu\n", hc->extended);
+	seq_printf(m, "timeouts spurious: %llu\n", hc->spurious);
+	seq_printf(m, "hangs: %llu\n", hc->hangs);
+	seq_printf(m, "watchdog faults: %llu\n", hc->watchdog_faults);
+	seq_printf(m, "last decision: %s\n",
+		   amdgpu_ring_hang_reason_name(hc->last_reason));
+	mutex_unlock(&hc->lock);
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(amdgpu_debugfs_hangcheck);
+
 #endif
 
 void amdgpu_debugfs_ring_init(struct amdgpu_device *adev,
@@ -626,6 +793,10 @@ void amdgpu_debugfs_ring_init(struct amdgpu_device *adev,
 	debugfs_create_file(name, 0200, root, ring,
 			    &amdgpu_debugfs_error_fops);
 
+	sprintf(name, "amdgpu_hang_%s", ring->name);
+	debugfs_create_file(name, 0444, root, ring,
+			    &amdgpu_debugfs_hangcheck_fops);
+
 #endif
 }
 
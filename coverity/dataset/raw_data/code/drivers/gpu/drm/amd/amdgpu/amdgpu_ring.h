@@ -64,6 +64,12 @@ enum amdgpu_ring_priority_level {
 #define AMDGPU_FENCE_FLAG_TC_WB_ONLY    (1 << 2)
 #define AMDGPU_FENCE_FLAG_EXEC          (1 << 3)
 
+/* upper bound for amdgpu_fence_poll_us, longer waits should sleep */
+#define AMDGPU_FENCE_POLL_MAX_US	1000
+
+/* buckets of the fence signal latency histogram, <1us to >=256us */
+#define AMDGPU_FENCE_SIGNAL_HIST	10
+
 #define to_amdgpu_ring(s) container_of((s), struct amdgpu_ring, sched)
 
 #define AMDGPU_IB_POOL_SIZE	(1024 * 1024)
@@ -95,8 +101,13 @@ enum amdgpu_ib_pool_type {
 	AMDGPU_IB_POOL_MAX
 };
 
+struct amdgpu_ib_pool;
+struct amdgpu_ib_pool_chunk;
+
 struct amdgpu_ib {
 	struct drm_suballoc		*sa_bo;
+	/* per ring pool chunk the IB was allocated from, if any */
+	struct amdgpu_ib_pool_chunk	*chunk;
 	uint32_t			length_dw;
 	uint64_t			gpu_addr;
 	uint32_t			*ptr;
@@ -124,6 +135,21 @@ struct amdgpu_fence_driver {
 	unsigned			num_fences_mask;
 	spinlock_t			lock;
 	struct dma_fence		**fences;
+
+	/* hybrid CS fence wait, see amdgpu_fence_wait_hybrid() */
+	u64				wait_avg_ns;
+	atomic64_t			poll_waits;
+	atomic64_t			poll_hits;
+	atomic64_t			poll_ns;
+
+	/* deferred signaling, see amdgpu_fence_signal_work() */
+	bool				deferred_signal;
+	/* last seq signaled by the worker, only touched by the worker */
+	uint32_t			signaled_seq;
+	ktime_t				signal_stamp;
+	struct work_struct		signal_work;
+	/* seq observed to fence signaled latency, log2 us buckets */
+	atomic64_t			signal_hist[AMDGPU_FENCE_SIGNAL_HIST];
 };
 
 extern const struct drm_sched_backend_ops amdgpu_sched_ops;
@@ -145,6 +171,8 @@ int amdgpu_fence_emit(struct amdgpu_ring *ring, struct dma_fence **fence, struct
 int amdgpu_fence_emit_polling(struct amdgpu_ring *ring, uint32_t *s,
 			      uint32_t timeout);
 bool amdgpu_fence_process(struct amdgpu_ring *ring);
+long amdgpu_fence_wait_hybrid(struct dma_fence *fence, bool intr,
+			      long timeout);
 int amdgpu_fence_wait_empty(struct amdgpu_ring *ring);
 signed long amdgpu_fence_wait_polling(struct amdgpu_ring *ring,
 				      uint32_t wait_seq,
@@ -239,6 +267,43 @@ struct amdgpu_ring_funcs {
 	void (*emit_cleaner_shader)(struct amdgpu_ring *ring);
 };
 
+/* maximum number of timeouts extended for a ring still fetching commands */
+#define AMDGPU_RING_HANGCHECK_MAX_EXTENSIONS	8
+
+enum amdgpu_ring_hang_reason {
+	AMDGPU_RING_HANG_NONE = 0,
+	/* fences signaled since the last sample */
+	AMDGPU_RING_HANG_FENCE_PROGRESS,
+	/* the CP still advanced the read pointer */
+	AMDGPU_RING_HANG_RPTR_PROGRESS,
+	/* nothing moved since the last sample */
+	AMDGPU_RING_HANG_NO_PROGRESS,
+	/* the job finished before the timeout handler ran */
+	AMDGPU_RING_HANG_SIGNALED,
+	/* still progressing, but extended too often */
+	AMDGPU_RING_HANG_EXTEND_LIMIT,
+	/* the watchdog saw no progress for hang_stall_ms */
+	AMDGPU_RING_HANG_WATCHDOG,
+};
+
+struct amdgpu_ring_hangcheck {
+	struct mutex			lock;
+	struct delayed_work		work;
+	/* ring state at the last sample */
+	uint32_t			last_seq;
+	u64				last_rptr;
+	/* jiffies of the last sample which saw progress */
+	unsigned long			last_progress;
+	unsigned int			extensions;
+	enum amdgpu_ring_hang_reason	last_reason;
+	/* statistics */
+	uint64_t			samples;
+	uint64_t			extended;
+	uint64_t			spurious;
+	uint64_t			hangs;
+	uint64_t			watchdog_faults;
+};
+
 struct amdgpu_ring {
 	struct amdgpu_device		*adev;
 	const struct amdgpu_ring_funcs	*funcs;
@@ -307,6 +372,7 @@ struct amdgpu_ring {
 	bool            is_sw_ring;
 	unsigned int    entry_index;
 
+	struct amdgpu_ring_hangcheck	hangcheck;
 };
 
 #define amdgpu_ring_parse_cs(r, p, job, ib) ((r)->funcs->parse_cs((p), (job), (ib)))
@@ -355,6 +421,7 @@ int amdgpu_ring_init(struct amdgpu_device *adev, struct amdgpu_ring *ring,
 		     unsigned int irq_type, unsigned int hw_prio,
 		     atomic_t *sched_score);
 void amdgpu_ring_fini(struct amdgpu_ring *ring);
+bool amdgpu_ring_hangcheck(struct amdgpu_ring *ring, struct dma_fence *fence);
 void amdgpu_ring_emit_reg_write_reg_wait_helper(struct amdgpu_ring *ring,
 						uint32_t reg0, uint32_t val0,
 						uint32_t reg1, uint32_t val1);
@@ -415,6 +482,35 @@ static inline void amdgpu_ring_write_multiple(struct amdgpu_ring *ring,
 	ring->count_dw -= count_dw;
 }
 
+/**
+ * amdgpu_ring_write_fill - write the same dword multiple times
+ * @ring: amdgpu_ring structure
+ * @v: dword to write
+ * @count_dw: number of times to write it
+ *
+ * Bulk version of amdgpu_ring_write() for padding, fills the ring in at most
+ * two chunks around the wrap instead of one dword at a time.
+ */
+static inline void amdgpu_ring_write_fill(struct amdgpu_ring *ring,
+					  uint32_t v, unsigned int count_dw)
+{
+	unsigned int occupied, chunk1;
+
+	if (unlikely(ring->count_dw < count_dw))
+		DRM_ERROR("amdgpu: writing more dwords to the ring than expected!\n");
+
+	occupied = ring->wptr & ring->buf_mask;
+	chunk1 = min(ring->buf_mask + 1 - occupied, count_dw);
+
+	memset32(&ring->ring[occupied], v, chunk1);
+	if (count_dw > chunk1)
+		memset32(ring->ring, v, count_dw - chunk1);
+
+	ring->wptr += count_dw;
+	ring->wptr &= ring->ptr_mask;
+	ring->count_dw -= count_dw;
+}
+
 /**
  * amdgpu_ring_patch_cond_exec - patch dw count of conditional execute
  * @ring: amdgpu_ring structure
@@ -470,6 +566,9 @@ int amdgpu_ib_get(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 		  unsigned size,
 		  enum amdgpu_ib_pool_type pool,
 		  struct amdgpu_ib *ib);
+int amdgpu_ib_get_ring(struct amdgpu_device *adev, struct amdgpu_ring *ring,
+		       unsigned int size, enum amdgpu_ib_pool_type pool_type,
+		       struct amdgpu_ib *ib);
 void amdgpu_ib_free(struct amdgpu_device *adev, struct amdgpu_ib *ib,
 		    struct dma_fence *f);
 int amdgpu_ib_schedule(struct amdgpu_ring *ring, unsigned num_ibs,
@@ -554,6 +554,27 @@ TRACE_EVENT(amdgpu_reset_reg_dumps,
 		      __entry->value)
 );
 
+TRACE_EVENT(amdgpu_psp_cmd,
+	    TP_PROTO(uint32_t cmd_id, uint32_t index, uint32_t status,
+		     u64 latency_us),
+	    TP_ARGS(cmd_id, index, status, latency_us),
+	    TP_STRUCT__entry(
+			     __field(uint32_t, cmd_id)
+			     __field(uint32_t, index)
+			     __field(uint32_t, status)
+			     __field(u64, latency_us)
+			     ),
+	    TP_fast_assign(
+			   __entry->cmd_id = cmd_id;
+			   __entry->index = index;
+			   __entry->status = status;
+			   __entry->latency_us = latency_us;
+			   ),
+	    TP_printk("psp cmd=0x%x, fence=%u, status=0x%x, latency=%lluus",
+		      __entry->cmd_id, __entry->index,
+		      __entry->status, __entry->latency_us)
+);
+
 #undef AMDGPU_JOB_GET_TIMELINE_NAME
 #endif
 
@@ -364,6 +364,59 @@ error:
 	return r;
 }
 
+struct amdgpu_ttm_evict_cb {
+	struct dma_fence_cb	cb;
+	struct amdgpu_device	*adev;
+	u64			bytes;
+	ktime_t			start;
+};
+
+static void amdgpu_ttm_evict_account(struct amdgpu_device *adev, u64 bytes,
+				     ktime_t start)
+{
+	atomic64_inc(&adev->mman.evict_copies);
+	atomic64_add(bytes, &adev->mman.evict_bytes);
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     &adev->mman.evict_copy_ns);
+}
+
+static void amdgpu_ttm_evict_cb(struct dma_fence *fence,
+				struct dma_fence_cb *cb)
+{
+	struct amdgpu_ttm_evict_cb *ecb =
+		container_of(cb, struct amdgpu_ttm_evict_cb, cb);
+
+	amdgpu_ttm_evict_account(ecb->adev, ecb->bytes, ecb->start);
+	kfree(ecb);
+}
+
+/*
+ * amdgpu_ttm_evict_track - account a VRAM eviction copy
+ *
+ * Measures the time from submission until the copy fence signals, so the
+ * resulting bandwidth includes the time the copy spent queued behind other
+ * work on the buffer funcs ring. Tracking is best effort and skipped when
+ * the allocation fails.
+ */
+static void amdgpu_ttm_evict_track(struct amdgpu_device *adev,
+				   struct dma_fence *fence, u64 bytes,
+				   ktime_t start)
+{
+	struct amdgpu_ttm_evict_cb *ecb;
+
+	ecb = kmalloc(sizeof(*ecb), GFP_NOWAIT | __GFP_NOWARN);
+	if (!ecb)
+		return;
+
+	ecb->adev = adev;
+	ecb->bytes = bytes;
+	ecb->start = start;
+	if (dma_fence_add_callback(fence, &ecb->cb, amdgpu_ttm_evict_cb)) {
+		amdgpu_ttm_evict_account(adev, bytes, start);
+		kfree(ecb);
+	}
+}
+
 /*
  * amdgpu_move_blit - Copy an entire buffer to another buffer
  *
@@ -379,6 +432,7 @@ static int amdgpu_move_blit(struct ttm_buffer_object *bo,
 	struct amdgpu_bo *abo = ttm_to_amdgpu_bo(bo);
 	struct amdgpu_copy_mem src, dst;
 	struct dma_fence *fence = NULL;
+	ktime_t start = ktime_get();
 	int r;
 
 	src.bo = bo;
@@ -395,6 +449,9 @@ static int amdgpu_move_blit(struct ttm_buffer_object *bo,
 	if (r)
 		goto error;
 
+	if (evict && old_mem->mem_type == TTM_PL_VRAM && fence)
+		amdgpu_ttm_evict_track(adev, fence, new_mem->size, start);
+
 	/* clear the space being freed */
 	if (old_mem->mem_type == TTM_PL_VRAM &&
 	    (abo->flags & AMDGPU_GEM_CREATE_VRAM_WIPE_ON_RELEASE)) {
@@ -458,6 +515,48 @@ bool amdgpu_res_cpu_visible(struct amdgpu_device *adev,
 	return true;
 }
 
+/**
+ * amdgpu_res_cpu_visible_pages - Count the CPU visible pages of a range
+ * @adev: amdgpu device
+ * @res: the VRAM resource to check
+ * @page_offset: first page of the range
+ * @num_pages: maximum number of pages in the range
+ *
+ * Returns: the number of consecutive CPU visible pages starting at
+ * @page_offset, 0 if that page itself isn't CPU visible.
+ */
+pgoff_t amdgpu_res_cpu_visible_pages(struct amdgpu_device *adev,
+				     struct ttm_resource *res,
+				     pgoff_t page_offset, pgoff_t num_pages)
+{
+	u64 visible_size = adev->gmc.visible_vram_size;
+	u64 offset = (u64)page_offset << PAGE_SHIFT;
+	struct amdgpu_res_cursor cursor;
+	pgoff_t pages = 0;
+
+	if (!res || res->mem_type != TTM_PL_VRAM || offset >= res->size)
+		return 0;
+
+	amdgpu_res_first(res, offset,
+			 min_t(u64, res->size - offset,
+			       (u64)num_pages << PAGE_SHIFT), &cursor);
+	while (cursor.remaining) {
+		u64 size;
+
+		if (cursor.start >= visible_size)
+			break;
+
+		size = min(cursor.size, visible_size - cursor.start);
+		pages += size >> PAGE_SHIFT;
+		if (size < cursor.size)
+			break;
+
+		amdgpu_res_next(&cursor, cursor.size);
+	}
+
+	return pages;
+}
+
 /*
  * amdgpu_res_copyable - Check that memory can be accessed by ttm_bo_move_memcpy
  *
@@ -1106,8 +1205,14 @@ static struct ttm_tt *amdgpu_ttm_tt_create(struct ttm_buffer_object *bo,
 		return NULL;
 
 	gtt->gobj = &bo->base;
-	if (adev->gmc.mem_partitions && abo->xcp_id >= 0)
+	/* Partition pools only exist on APUs, dGPUs use the NUMA node pools */
+	if (adev->gmc.is_app_apu && adev->gmc.mem_partitions &&
+	    abo->xcp_id >= 0)
 		gtt->pool_id = KFD_XCP_MEM_ID(adev, abo->xcp_id);
+	else if (adev->mman.gtt_numa == 2)
+		gtt->pool_id = numa_mem_id();
+	else if (adev->mman.gtt_numa == 1)
+		gtt->pool_id = dev_to_node(adev->dev);
 	else
 		gtt->pool_id = abo->xcp_id;
 
@@ -1124,6 +1229,30 @@ static struct ttm_tt *amdgpu_ttm_tt_create(struct ttm_buffer_object *bo,
 	return &gtt->ttm;
 }
 
+/*
+ * Account the pages of a ttm_tt object to the NUMA nodes they were allocated
+ * from, in runs of pages from the same node.
+ */
+static void amdgpu_ttm_tt_account_nodes(struct amdgpu_device *adev,
+					struct ttm_tt *ttm, int sign)
+{
+	pgoff_t i, start = 0;
+	int nid;
+
+	if (!adev->mman.gtt_node_pages)
+		return;
+
+	for (i = 1; i <= ttm->num_pages; ++i) {
+		nid = page_to_nid(ttm->pages[start]);
+		if (i < ttm->num_pages && page_to_nid(ttm->pages[i]) == nid)
+			continue;
+
+		atomic64_add(sign * (s64)(i - start),
+			     &adev->mman.gtt_node_pages[nid]);
+		start = i;
+	}
+}
+
 /*
  * amdgpu_ttm_tt_populate - Map GTT pages visible to the device
  *
@@ -1151,7 +1280,8 @@ static int amdgpu_ttm_tt_populate(struct ttm_device *bdev,
 	if (ttm->page_flags & TTM_TT_FLAG_EXTERNAL)
 		return 0;
 
-	if (adev->mman.ttm_pools && gtt->pool_id >= 0)
+	if (adev->mman.ttm_pools && gtt->pool_id >= 0 &&
+	    gtt->pool_id < adev->mman.num_ttm_pools)
 		pool = &adev->mman.ttm_pools[gtt->pool_id];
 	else
 		pool = &adev->mman.bdev.pool;
@@ -1162,6 +1292,7 @@ static int amdgpu_ttm_tt_populate(struct ttm_device *bdev,
 	for (i = 0; i < ttm->num_pages; ++i)
 		ttm->pages[i]->mapping = bdev->dev_mapping;
 
+	amdgpu_ttm_tt_account_nodes(adev, ttm, 1);
 	return 0;
 }
 
@@ -1195,8 +1326,10 @@ static void amdgpu_ttm_tt_unpopulate(struct ttm_device *bdev,
 		ttm->pages[i]->mapping = NULL;
 
 	adev = amdgpu_ttm_adev(bdev);
+	amdgpu_ttm_tt_account_nodes(adev, ttm, -1);
 
-	if (adev->mman.ttm_pools && gtt->pool_id >= 0)
+	if (adev->mman.ttm_pools && gtt->pool_id >= 0 &&
+	    gtt->pool_id < adev->mman.num_ttm_pools)
 		pool = &adev->mman.ttm_pools[gtt->pool_id];
 	else
 		pool = &adev->mman.bdev.pool;
@@ -1798,11 +1931,54 @@ static int amdgpu_ttm_reserve_tmr(struct amdgpu_device *adev)
 	return 0;
 }
 
+/*
+ * dGPUs get one pool per NUMA node so GTT can be placed close to the device
+ * or the process using it, the page allocator falls back to other nodes.
+ */
+static int amdgpu_ttm_numa_pools_init(struct amdgpu_device *adev)
+{
+	int policy = amdgpu_gtt_numa;
+	int i;
+
+	if (policy < 0)
+		policy = 1;
+
+	if (!policy || num_online_nodes() < 2 ||
+	    (policy == 1 && dev_to_node(adev->dev) == NUMA_NO_NODE))
+		return 0;
+
+	adev->mman.ttm_pools = kcalloc(nr_node_ids,
+				       sizeof(*adev->mman.ttm_pools),
+				       GFP_KERNEL);
+	if (!adev->mman.ttm_pools)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_node_ids; i++)
+		ttm_pool_init(&adev->mman.ttm_pools[i], adev->dev, i,
+			      adev->need_swiotlb,
+			      dma_addressing_limited(adev->dev));
+	adev->mman.num_ttm_pools = nr_node_ids;
+
+	adev->mman.gtt_numa = policy;
+	dev_info(adev->dev, "GTT placed on %s NUMA node\n",
+		 policy == 1 ? "the device" : "the allocating process'");
+	return 0;
+}
+
 static int amdgpu_ttm_pools_init(struct amdgpu_device *adev)
 {
 	int i;
 
-	if (!adev->gmc.is_app_apu || !adev->gmc.num_mem_partitions)
+	adev->mman.gtt_node_pages = kcalloc(nr_node_ids,
+					    sizeof(*adev->mman.gtt_node_pages),
+					    GFP_KERNEL);
+	if (!adev->mman.gtt_node_pages)
+		return -ENOMEM;
+
+	if (!adev->gmc.is_app_apu)
+		return amdgpu_ttm_numa_pools_init(adev);
+
+	if (!adev->gmc.num_mem_partitions)
 		return 0;
 
 	adev->mman.ttm_pools = kcalloc(adev->gmc.num_mem_partitions,
@@ -1816,6 +1992,7 @@ static int amdgpu_ttm_pools_init(struct amdgpu_device *adev)
 			      adev->gmc.mem_partitions[i].numa.node,
 			      false, false);
 	}
+	adev->mman.num_ttm_pools = adev->gmc.num_mem_partitions;
 	return 0;
 }
 
@@ -1823,14 +2000,19 @@ static void amdgpu_ttm_pools_fini(struct amdgpu_device *adev)
 {
 	int i;
 
-	if (!adev->gmc.is_app_apu || !adev->mman.ttm_pools)
+	kfree(adev->mman.gtt_node_pages);
+	adev->mman.gtt_node_pages = NULL;
+
+	if (!adev->mman.ttm_pools)
 		return;
 
-	for (i = 0; i < adev->gmc.num_mem_partitions; i++)
+	for (i = 0; i < adev->mman.num_ttm_pools; i++)
 		ttm_pool_fini(&adev->mman.ttm_pools[i]);
 
 	kfree(adev->mman.ttm_pools);
 	adev->mman.ttm_pools = NULL;
+	adev->mman.num_ttm_pools = 0;
+	adev->mman.gtt_numa = 0;
 }
 
 /*
@@ -1863,6 +2045,7 @@ int amdgpu_ttm_init(struct amdgpu_device *adev)
 	r = amdgpu_ttm_pools_init(adev);
 	if (r) {
 		DRM_ERROR("failed to init ttm pools(%d).\n", r);
+		amdgpu_ttm_pools_fini(adev);
 		return r;
 	}
 	adev->mman.initialized = true;
@@ -2409,6 +2592,41 @@ static int amdgpu_ttm_page_pool_show(struct seq_file *m, void *unused)
 
 DEFINE_SHOW_ATTRIBUTE(amdgpu_ttm_page_pool);
 
+static int amdgpu_ttm_dmabuf_info_show(struct seq_file *m, void *unused)
+{
+	struct amdgpu_device *adev = m->private;
+	u64 segments = atomic64_read(&adev->mman.dmabuf_sg_segments);
+	u64 bytes = atomic64_read(&adev->mman.dmabuf_sg_bytes);
+
+	seq_printf(m, "map hits: %lld misses: %lld\n",
+		   atomic64_read(&adev->mman.dmabuf_map_hits),
+		   atomic64_read(&adev->mman.dmabuf_map_misses));
+	seq_printf(m, "sg segments: %llu avg segment size: %llu KiB\n",
+		   segments, segments ? div64_u64(bytes, segments) >> 10 : 0);
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(amdgpu_ttm_dmabuf_info);
+
+static int amdgpu_ttm_evict_stats_show(struct seq_file *m, void *unused)
+{
+	struct amdgpu_device *adev = m->private;
+	u64 bytes = atomic64_read(&adev->mman.evict_bytes);
+	u64 ns = atomic64_read(&adev->mman.evict_copy_ns);
+
+	seq_printf(m, "vram eviction copies: %lld bytes: %llu\n",
+		   atomic64_read(&adev->mman.evict_copies), bytes);
+	seq_printf(m, "vram eviction bandwidth: %llu MiB/s\n",
+		   ns ? div64_u64(bytes * 1000, ns) * 1000000 >> 20 : 0);
+	seq_printf(m, "cpu fault moves: %lld bytes: %lld windowed faults: %lld\n",
+		   atomic64_read(&adev->num_vram_cpu_page_faults),
+		   atomic64_read(&adev->num_vram_cpu_fault_bytes),
+		   atomic64_read(&adev->num_vram_cpu_window_faults));
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(amdgpu_ttm_evict_stats);
+
 /*
  * amdgpu_ttm_vram_read - Linear read access to VRAM
  *
@@ -2618,6 +2836,10 @@ void amdgpu_ttm_debugfs_init(struct amdgpu_device *adev)
 			    &amdgpu_ttm_iomem_fops);
 	debugfs_create_file("ttm_page_pool", 0444, root, adev,
 			    &amdgpu_ttm_page_pool_fops);
+	debugfs_create_file("amdgpu_dmabuf_info", 0444, root, adev,
+			    &amdgpu_ttm_dmabuf_info_fops);
+	debugfs_create_file("amdgpu_evict_stats", 0444, root, adev,
+			    &amdgpu_ttm_evict_stats_fops);
 	ttm_resource_manager_create_debugfs(ttm_manager_type(&adev->mman.bdev,
 							     TTM_PL_VRAM),
 					    root, "amdgpu_vram_mm");
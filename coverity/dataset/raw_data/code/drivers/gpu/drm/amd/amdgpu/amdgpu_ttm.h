@@ -52,6 +52,11 @@ struct amdgpu_gtt_mgr {
 struct amdgpu_mman {
 	struct ttm_device		bdev;
 	struct ttm_pool			*ttm_pools;
+	int				num_ttm_pools;
+	/* GTT NUMA placement on dGPUs, one pool per node, see amdgpu_gtt_numa */
+	int				gtt_numa;
+	/* pages backing GTT BOs per NUMA node */
+	atomic64_t			*gtt_node_pages;
 	bool				initialized;
 	void __iomem			*aper_base_kaddr;
 
@@ -101,6 +106,17 @@ struct amdgpu_mman {
 	/* PAGE_SIZE'd BO for process memory r/w over SDMA. */
 	struct amdgpu_bo	*sdma_access_bo;
 	void			*sdma_access_ptr;
+
+	/* DMA-buf export statistics */
+	atomic64_t		dmabuf_map_hits;
+	atomic64_t		dmabuf_map_misses;
+	atomic64_t		dmabuf_sg_segments;
+	atomic64_t		dmabuf_sg_bytes;
+
+	/* VRAM eviction copy statistics */
+	atomic64_t		evict_copies;
+	atomic64_t		evict_bytes;
+	atomic64_t		evict_copy_ns;
 };
 
 struct amdgpu_copy_mem {
@@ -152,6 +168,9 @@ int amdgpu_vram_mgr_reserve_range(struct amdgpu_vram_mgr *mgr,
 int amdgpu_vram_mgr_query_page_status(struct amdgpu_vram_mgr *mgr,
 				      uint64_t start);
 
+pgoff_t amdgpu_res_cpu_visible_pages(struct amdgpu_device *adev,
+				     struct ttm_resource *res,
+				     pgoff_t page_offset, pgoff_t num_pages);
 bool amdgpu_res_cpu_visible(struct amdgpu_device *adev,
 			    struct ttm_resource *res);
 
@@ -801,6 +801,24 @@ static int amdgpu_uvd_cs_msg_decode(struct amdgpu_device *adev, uint32_t *msg,
 	return 0;
 }
 
+/*
+ * Find the slot of a session handle. Slots are probed starting at one
+ * derived from the handle, which is also where new sessions are placed.
+ */
+static int amdgpu_uvd_find_handle(struct amdgpu_device *adev,
+				  uint32_t handle)
+{
+	unsigned int i, idx;
+
+	for (i = 0; i < adev->uvd.max_handles; ++i) {
+		idx = (handle + i) % adev->uvd.max_handles;
+		if (atomic_read(&adev->uvd.handles[idx]) == handle)
+			return idx;
+	}
+
+	return -ENOENT;
+}
+
 /**
  * amdgpu_uvd_cs_msg - handle UVD message
  *
@@ -847,16 +865,18 @@ static int amdgpu_uvd_cs_msg(struct amdgpu_uvd_cs_ctx *ctx,
 		/* it's a create msg, calc image size (width * height) */
 		amdgpu_bo_kunmap(bo);
 
+		if (amdgpu_uvd_find_handle(adev, handle) >= 0) {
+			DRM_ERROR(")Handle 0x%x already in use!\n", handle);
+			return -EINVAL;
+		}
+
 		/* try to alloc a new handle */
 		for (i = 0; i < adev->uvd.max_handles; ++i) {
-			if (atomic_read(&adev->uvd.handles[i]) == handle) {
-				DRM_ERROR(")Handle 0x%x already in use!\n",
-					  handle);
-				return -EINVAL;
-			}
+			unsigned int idx = ((uint32_t)handle + i) %
+				adev->uvd.max_handles;
 
-			if (!atomic_cmpxchg(&adev->uvd.handles[i], 0, handle)) {
-				adev->uvd.filp[i] = ctx->parser->filp;
+			if (!atomic_cmpxchg(&adev->uvd.handles[idx], 0, handle)) {
+				adev->uvd.filp[idx] = ctx->parser->filp;
 				return 0;
 			}
 		}
@@ -872,18 +892,17 @@ static int amdgpu_uvd_cs_msg(struct amdgpu_uvd_cs_ctx *ctx,
 			return r;
 
 		/* validate the handle */
-		for (i = 0; i < adev->uvd.max_handles; ++i) {
-			if (atomic_read(&adev->uvd.handles[i]) == handle) {
-				if (adev->uvd.filp[i] != ctx->parser->filp) {
-					DRM_ERROR("UVD handle collision detected!\n");
-					return -EINVAL;
-				}
-				return 0;
-			}
+		i = amdgpu_uvd_find_handle(adev, handle);
+		if (i < 0) {
+			DRM_ERROR("Invalid UVD handle 0x%x!\n", handle);
+			return -ENOENT;
 		}
 
-		DRM_ERROR("Invalid UVD handle 0x%x!\n", handle);
-		return -ENOENT;
+		if (adev->uvd.filp[i] != ctx->parser->filp) {
+			DRM_ERROR("UVD handle collision detected!\n");
+			return -EINVAL;
+		}
+		return 0;
 
 	case 2:
 		/* it's a destroy msg, free the handle */
@@ -699,26 +699,31 @@ static int amdgpu_vce_cs_reloc(struct amdgpu_cs_parser *p, struct amdgpu_ib *ib,
 static int amdgpu_vce_validate_handle(struct amdgpu_cs_parser *p,
 				      uint32_t handle, uint32_t *allocated)
 {
-	unsigned int i;
+	unsigned int i, idx;
 
-	/* validate the handle */
+	/*
+	 * Validate the handle, probing from the slot derived from the handle
+	 * which is where new sessions are placed.
+	 */
 	for (i = 0; i < AMDGPU_MAX_VCE_HANDLES; ++i) {
-		if (atomic_read(&p->adev->vce.handles[i]) == handle) {
-			if (p->adev->vce.filp[i] != p->filp) {
+		idx = (handle + i) % AMDGPU_MAX_VCE_HANDLES;
+		if (atomic_read(&p->adev->vce.handles[idx]) == handle) {
+			if (p->adev->vce.filp[idx] != p->filp) {
 				DRM_ERROR("VCE handle collision detected!\n");
 				return -EINVAL;
 			}
-			return i;
+			return idx;
 		}
 	}
 
 	/* handle not found try to alloc a new one */
 	for (i = 0; i < AMDGPU_MAX_VCE_HANDLES; ++i) {
-		if (!atomic_cmpxchg(&p->adev->vce.handles[i], 0, handle)) {
-			p->adev->vce.filp[i] = p->filp;
-			p->adev->vce.img_size[i] = 0;
-			*allocated |= 1 << i;
-			return i;
+		idx = (handle + i) % AMDGPU_MAX_VCE_HANDLES;
+		if (!atomic_cmpxchg(&p->adev->vce.handles[idx], 0, handle)) {
+			p->adev->vce.filp[idx] = p->filp;
+			p->adev->vce.img_size[idx] = 0;
+			*allocated |= 1 << idx;
+			return idx;
 		}
 	}
 
@@ -683,7 +683,8 @@ int amdgpu_vm_flush(struct amdgpu_ring *ring, struct amdgpu_job *job,
 
 	if (adev->gfx.enable_cleaner_shader &&
 	    ring->funcs->emit_cleaner_shader &&
-	    job->enforce_isolation)
+	    job->enforce_isolation &&
+	    amdgpu_gfx_cleaner_shader_needed(ring, job->pasid))
 		ring->funcs->emit_cleaner_shader(ring);
 
 	if (!vm_flush_needed && !gds_switch_needed && !need_pipe_sync)
@@ -1581,9 +1582,12 @@ int amdgpu_vm_flush_compute_tlb(struct amdgpu_device *adev,
 	 * and the worst thing which could happen is that we flush the changes
 	 * into the TLB once more which is harmless.
 	 */
+	atomic64_inc(&adev->vm_manager.tlb_flush_requested);
 	if (atomic64_xchg(&vm->kfd_last_flushed_seq, tlb_seq) == tlb_seq)
 		return 0;
 
+	atomic64_inc(&adev->vm_manager.tlb_flush_issued);
+
 	if (adev->family == AMDGPU_FAMILY_AI ||
 	    adev->family == AMDGPU_FAMILY_RV)
 		all_hub = true;
@@ -2428,8 +2432,10 @@ int amdgpu_vm_init(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 	int r, i;
 
 	vm->va = RB_ROOT_CACHED;
-	for (i = 0; i < AMDGPU_MAX_VMHUBS; i++)
+	for (i = 0; i < AMDGPU_MAX_VMHUBS; i++) {
 		vm->reserved_vmid[i] = NULL;
+		vm->vmid_hint[i] = 0;
+	}
 	INIT_LIST_HEAD(&vm->evicted);
 	INIT_LIST_HEAD(&vm->evicted_user);
 	INIT_LIST_HEAD(&vm->relocated);
@@ -2441,6 +2447,8 @@ int amdgpu_vm_init(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 	INIT_LIST_HEAD(&vm->done);
 	INIT_LIST_HEAD(&vm->pt_freed);
 	INIT_WORK(&vm->pt_free_work, amdgpu_vm_pt_free_work);
+	INIT_LIST_HEAD(&vm->pt_cache);
+	vm->pt_cache_count = 0;
 	INIT_KFIFO(vm->faults);
 
 	r = amdgpu_vm_init_entities(adev, vm);
@@ -2473,6 +2481,9 @@ int amdgpu_vm_init(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 	mutex_init(&vm->eviction_lock);
 	vm->evicting = false;
 	vm->tlb_fence_context = dma_fence_context_alloc(1);
+	spin_lock_init(&vm->tlb_flush_lock);
+	INIT_LIST_HEAD(&vm->tlb_flush_pending);
+	INIT_WORK(&vm->tlb_flush_work, amdgpu_vm_tlb_fence_work);
 
 	r = amdgpu_vm_pt_create(adev, vm, adev->vm_manager.root_level,
 				false, &root, xcp_id);
@@ -2482,6 +2493,8 @@ int amdgpu_vm_init(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 	root_bo = amdgpu_bo_ref(&root->bo);
 	r = amdgpu_bo_reserve(root_bo, true);
 	if (r) {
+		atomic64_sub(amdgpu_vm_pt_bo_size(root),
+			     &adev->vm_manager.pt_bytes);
 		amdgpu_bo_unref(&root->shadow);
 		amdgpu_bo_unref(&root_bo);
 		goto error_free_delayed;
@@ -2576,6 +2589,9 @@ int amdgpu_vm_make_compute(struct amdgpu_device *adev, struct amdgpu_vm *vm)
 	vm->is_compute_context = true;
 
 	/* Free the shadow bo for compute VM */
+	if (to_amdgpu_bo_vm(vm->root.bo)->shadow)
+		atomic64_sub(amdgpu_bo_size(to_amdgpu_bo_vm(vm->root.bo)->shadow),
+			     &adev->vm_manager.pt_bytes);
 	amdgpu_bo_unref(&to_amdgpu_bo_vm(vm->root.bo)->shadow);
 
 	goto unreserve_bo;
@@ -2631,6 +2647,8 @@ void amdgpu_vm_fini(struct amdgpu_device *adev, struct amdgpu_vm *vm)
 	spin_lock_irqsave(vm->last_tlb_flush->lock, flags);
 	spin_unlock_irqrestore(vm->last_tlb_flush->lock, flags);
 	dma_fence_put(vm->last_tlb_flush);
+	/* Make sure that all queued TLB fences are signaled */
+	flush_work(&vm->tlb_flush_work);
 
 	list_for_each_entry_safe(mapping, tmp, &vm->freed, list) {
 		if (mapping->flags & AMDGPU_PTE_PRT_FLAG(adev) && prt_fini_needed) {
@@ -2699,6 +2717,12 @@ void amdgpu_vm_manager_init(struct amdgpu_device *adev)
 
 	spin_lock_init(&adev->vm_manager.prt_lock);
 	atomic_set(&adev->vm_manager.num_prt_users, 0);
+	atomic64_set(&adev->vm_manager.tlb_flush_requested, 0);
+	atomic64_set(&adev->vm_manager.tlb_flush_issued, 0);
+	atomic64_set(&adev->vm_manager.pt_created, 0);
+	atomic64_set(&adev->vm_manager.pt_reused, 0);
+	atomic64_set(&adev->vm_manager.pt_freed, 0);
+	atomic64_set(&adev->vm_manager.pt_bytes, 0);
 
 	/* If not overridden by the user, by default, only in large BAR systems
 	 * Compute VM tables will be updated by CPU
@@ -2839,6 +2863,13 @@ bool amdgpu_vm_handle_fault(struct amdgpu_device *adev, u32 pasid,
 	if (!vm)
 		goto error_unlock;
 
+	/* Keep retrying on userptrs which are being restored */
+	if (is_compute_context && amdgpu_amdkfd_userptr_fault(vm, addr)) {
+		amdgpu_bo_unreserve(root);
+		amdgpu_bo_unref(&root);
+		return true;
+	}
+
 	flags = AMDGPU_PTE_VALID | AMDGPU_PTE_SNOOPED |
 		AMDGPU_PTE_SYSTEM;
 
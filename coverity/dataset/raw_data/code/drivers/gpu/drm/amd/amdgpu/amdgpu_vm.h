@@ -148,6 +148,9 @@ struct amdgpu_mem_stats;
 /* How much VRAM be reserved for page tables */
 #define AMDGPU_VM_RESERVED_VRAM		(8ULL << 20)
 
+/* Maximum number of freed page tables each VM keeps for reuse */
+#define AMDGPU_VM_PT_CACHE_SIZE		64
+
 /*
  * max number of VMHUB
  * layout: max 8 GFXHUB + 4 MMHUB0 + 1 MMHUB1
@@ -364,6 +367,10 @@ struct amdgpu_vm {
 	struct list_head	pt_freed;
 	struct work_struct	pt_free_work;
 
+	/* freed PTs kept for reuse, protected by the root PD reservation */
+	struct list_head	pt_cache;
+	unsigned int		pt_cache_count;
+
 	/* contains the page directory */
 	struct amdgpu_vm_bo_base     root;
 	struct dma_fence	*last_update;
@@ -378,6 +385,11 @@ struct amdgpu_vm {
 	atomic64_t		kfd_last_flushed_seq;
 	uint64_t		tlb_fence_context;
 
+	/* TLB fences waiting to be handled by a single coalesced flush */
+	spinlock_t		tlb_flush_lock;
+	struct list_head	tlb_flush_pending;
+	struct work_struct	tlb_flush_work;
+
 	/* How many times we had to re-generate the page tables */
 	uint64_t		generation;
 
@@ -386,6 +398,8 @@ struct amdgpu_vm {
 
 	unsigned int		pasid;
 	bool			reserved_vmid[AMDGPU_MAX_VMHUBS];
+	/* VMID last used on each VMHUB, 0 if none */
+	unsigned int		vmid_hint[AMDGPU_MAX_VMHUBS];
 
 	/* Flag to indicate if VM tables are updated by CPU or GPU (SDMA) */
 	bool					use_cpu_for_update;
@@ -447,6 +461,16 @@ struct amdgpu_vm_manager {
 	spinlock_t				prt_lock;
 	atomic_t				num_prt_users;
 
+	/* TLB invalidations requested by PT updates vs. actually issued */
+	atomic64_t				tlb_flush_requested;
+	atomic64_t				tlb_flush_issued;
+
+	/* PD/PT allocation statistics, pt_bytes includes shadows and cached PTs */
+	atomic64_t				pt_created;
+	atomic64_t				pt_reused;
+	atomic64_t				pt_freed;
+	atomic64_t				pt_bytes;
+
 	/* controls how VM page tables are updated for Graphics and Compute.
 	 * BIT0[= 0] Graphics updated by SDMA [= 1] by CPU
 	 * BIT1[= 0] Compute updated by SDMA [= 1] by CPU
@@ -571,6 +595,7 @@ void amdgpu_vm_get_memory(struct amdgpu_vm *vm,
 
 int amdgpu_vm_pt_clear(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 		       struct amdgpu_bo_vm *vmbo, bool immediate);
+u64 amdgpu_vm_pt_bo_size(struct amdgpu_bo_vm *vmbo);
 int amdgpu_vm_pt_create(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 			int level, bool immediate, struct amdgpu_bo_vm **vmbo,
 			int32_t xcp_id);
@@ -654,5 +679,6 @@ void amdgpu_vm_update_fault_cache(struct amdgpu_device *adev,
 void amdgpu_vm_tlb_fence_create(struct amdgpu_device *adev,
 				 struct amdgpu_vm *vm,
 				 struct dma_fence **fence);
+void amdgpu_vm_tlb_fence_work(struct work_struct *work);
 
 #endif
@@ -21,6 +21,7 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <linux/dma-fence-array.h>
 #include <drm/drm_drv.h>
 
 #include "amdgpu.h"
@@ -343,6 +344,75 @@ static void amdgpu_vm_pt_next_dfs(struct amdgpu_device *adev,
 	     amdgpu_vm_pt_continue_dfs((start), (entry));			\
 	     (entry) = (cursor).entry, amdgpu_vm_pt_next_dfs((adev), &(cursor)))
 
+/**
+ * amdgpu_vm_pt_validate - make sure a PD/PT and its shadow are resident
+ *
+ * @vmbo: BO to validate
+ *
+ * Returns:
+ * 0 on success, errno otherwise.
+ */
+static int amdgpu_vm_pt_validate(struct amdgpu_bo_vm *vmbo)
+{
+	struct ttm_operation_ctx ctx = { true, false };
+	struct amdgpu_bo *bo = &vmbo->bo;
+	int r;
+
+	r = ttm_bo_validate(&bo->tbo, &bo->placement, &ctx);
+	if (r)
+		return r;
+
+	if (vmbo->shadow) {
+		struct amdgpu_bo *shadow = vmbo->shadow;
+
+		r = ttm_bo_validate(&shadow->tbo, &shadow->placement, &ctx);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
+/**
+ * amdgpu_vm_pt_clear_entries - add clearing a PD/PT to an update
+ *
+ * @params: parameters for the update
+ * @vmbo: BO to clear
+ * @level: level of the BO in the hierarchy
+ *
+ * Returns:
+ * 0 on success, errno otherwise.
+ */
+static int amdgpu_vm_pt_clear_entries(struct amdgpu_vm_update_params *params,
+				      struct amdgpu_bo_vm *vmbo,
+				      unsigned int level)
+{
+	struct amdgpu_device *adev = params->adev;
+	struct amdgpu_vm *vm = params->vm;
+	unsigned int entries = amdgpu_bo_size(&vmbo->bo) / 8;
+	uint64_t value = 0, flags = 0;
+	int r;
+
+	r = vm->update_funcs->map_table(vmbo);
+	if (r)
+		return r;
+
+	if (adev->asic_type >= CHIP_VEGA10) {
+		if (level != AMDGPU_VM_PTB) {
+			/* Handle leaf PDEs as PTEs */
+			flags |= AMDGPU_PDE_PTE_FLAG(adev);
+			amdgpu_gmc_get_vm_pde(adev, level,
+					      &value, &flags);
+		} else {
+			/* Workaround for fault priority problem on GMC9 */
+			flags = AMDGPU_PTE_EXECUTABLE;
+		}
+	}
+
+	return vm->update_funcs->update(params, vmbo, 0, 0, entries,
+					value, flags);
+}
+
 /**
  * amdgpu_vm_pt_clear - initially clear the PDs/PTs
  *
@@ -360,12 +430,8 @@ int amdgpu_vm_pt_clear(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 		       struct amdgpu_bo_vm *vmbo, bool immediate)
 {
 	unsigned int level = adev->vm_manager.root_level;
-	struct ttm_operation_ctx ctx = { true, false };
 	struct amdgpu_vm_update_params params;
 	struct amdgpu_bo *ancestor = &vmbo->bo;
-	unsigned int entries;
-	struct amdgpu_bo *bo = &vmbo->bo;
-	uint64_t addr;
 	int r, idx;
 
 	/* Figure out our place in the hierarchy */
@@ -377,27 +443,13 @@ int amdgpu_vm_pt_clear(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 		}
 	}
 
-	entries = amdgpu_bo_size(bo) / 8;
-
-	r = ttm_bo_validate(&bo->tbo, &bo->placement, &ctx);
+	r = amdgpu_vm_pt_validate(vmbo);
 	if (r)
 		return r;
 
-	if (vmbo->shadow) {
-		struct amdgpu_bo *shadow = vmbo->shadow;
-
-		r = ttm_bo_validate(&shadow->tbo, &shadow->placement, &ctx);
-		if (r)
-			return r;
-	}
-
 	if (!drm_dev_enter(adev_to_drm(adev), &idx))
 		return -ENODEV;
 
-	r = vm->update_funcs->map_table(vmbo);
-	if (r)
-		goto exit;
-
 	memset(&params, 0, sizeof(params));
 	params.adev = adev;
 	params.vm = vm;
@@ -407,23 +459,7 @@ int amdgpu_vm_pt_clear(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 	if (r)
 		goto exit;
 
-	addr = 0;
-
-	uint64_t value = 0, flags = 0;
-	if (adev->asic_type >= CHIP_VEGA10) {
-		if (level != AMDGPU_VM_PTB) {
-			/* Handle leaf PDEs as PTEs */
-			flags |= AMDGPU_PDE_PTE_FLAG(adev);
-			amdgpu_gmc_get_vm_pde(adev, level,
-					      &value, &flags);
-		} else {
-			/* Workaround for fault priority problem on GMC9 */
-			flags = AMDGPU_PTE_EXECUTABLE;
-		}
-	}
-
-	r = vm->update_funcs->update(&params, vmbo, addr, 0, entries,
-				     value, flags);
+	r = amdgpu_vm_pt_clear_entries(&params, vmbo, level);
 	if (r)
 		goto exit;
 
@@ -433,6 +469,179 @@ exit:
 	return r;
 }
 
+/**
+ * amdgpu_vm_pt_bo_size - memory used by a PD/PT
+ *
+ * @vmbo: the PD/PT
+ *
+ * Returns the size of the BO plus its shadow.
+ */
+u64 amdgpu_vm_pt_bo_size(struct amdgpu_bo_vm *vmbo)
+{
+	u64 size = amdgpu_bo_size(&vmbo->bo);
+
+	if (vmbo->shadow)
+		size += amdgpu_bo_size(vmbo->shadow);
+
+	return size;
+}
+
+/**
+ * amdgpu_vm_pt_cache_get - take a freed PT for reuse
+ *
+ * @vm: VM to take the PT from
+ *
+ * Freed PTs are kept on a per VM list, so that mapping and unmapping the
+ * same range doesn't create and destroy BOs all the time. Only PTs of the
+ * last level are kept since all of them have the same size and layout.
+ * The GPU may still walk a freed PT until its fence signals, so only the
+ * oldest PT is considered and only once it is idle.
+ * Root PD needs to be reserved when calling this.
+ *
+ * Returns:
+ * A cached PT or NULL if the cache has no idle PT.
+ */
+static struct amdgpu_bo_vm *amdgpu_vm_pt_cache_get(struct amdgpu_vm *vm)
+{
+	struct amdgpu_bo_vm *vmbo;
+
+	vmbo = list_first_entry_or_null(&vm->pt_cache, struct amdgpu_bo_vm,
+					pt_cache);
+	if (!vmbo || !dma_fence_is_signaled(vmbo->pt_cache_fence))
+		return NULL;
+
+	list_del_init(&vmbo->pt_cache);
+	vm->pt_cache_count--;
+	dma_fence_put(vmbo->pt_cache_fence);
+	vmbo->pt_cache_fence = NULL;
+
+	return vmbo;
+}
+
+/**
+ * amdgpu_vm_pt_cache_fence - fence for the last use of a freed PT
+ *
+ * @bo: the freed PT
+ *
+ * Page table updates, TLB flushes and submissions of the VM all share the
+ * root PD reservation, so the PT is unused once all of them signaled. The
+ * KFD eviction fence is skipped, it only signals when the process is evicted.
+ *
+ * Returns:
+ * The fence or NULL if it couldn't be allocated.
+ */
+static struct dma_fence *amdgpu_vm_pt_cache_fence(struct amdgpu_bo *bo)
+{
+	struct dma_fence_array *array;
+	struct dma_fence **fences;
+	unsigned int i, count;
+
+	if (dma_resv_get_fences(bo->tbo.base.resv, DMA_RESV_USAGE_BOOKKEEP,
+				&count, &fences))
+		return NULL;
+
+	for (i = 0; i < count;) {
+		if (to_amdgpu_amdkfd_fence(fences[i])) {
+			dma_fence_put(fences[i]);
+			fences[i] = fences[--count];
+		} else {
+			++i;
+		}
+	}
+
+	if (count <= 1) {
+		struct dma_fence *fence = count ? fences[0] :
+			dma_fence_get_stub();
+
+		kfree(fences);
+		return fence;
+	}
+
+	array = dma_fence_array_create(count, fences, dma_fence_context_alloc(1),
+				       1, false);
+	if (!array) {
+		for (i = 0; i < count; ++i)
+			dma_fence_put(fences[i]);
+		kfree(fences);
+		return NULL;
+	}
+
+	return &array->base;
+}
+
+/**
+ * amdgpu_vm_pt_cache_put - keep a freed PT for reuse
+ *
+ * @adev: amdgpu_device pointer
+ * @vm: VM the PT belonged to
+ * @bo: the freed PT, already detached from the VM
+ *
+ * Records the fence of everything which may still use the PT. PTs freed
+ * while an unlocked update is in flight are not cached, since that update
+ * isn't tracked in the reservation.
+ * Root PD needs to be reserved when calling this.
+ *
+ * Returns:
+ * True if the PT was cached and the caller must not free it.
+ */
+static bool amdgpu_vm_pt_cache_put(struct amdgpu_device *adev,
+				   struct amdgpu_vm *vm, struct amdgpu_bo *bo)
+{
+	unsigned int level = adev->vm_manager.root_level;
+	struct amdgpu_bo *ancestor;
+	struct amdgpu_bo_vm *vmbo;
+
+	if (vm->pt_cache_count >= AMDGPU_VM_PT_CACHE_SIZE || !bo->parent)
+		return false;
+
+	for (ancestor = bo; ancestor->parent; ancestor = ancestor->parent)
+		++level;
+	if (level != AMDGPU_VM_PTB)
+		return false;
+
+	if (!dma_fence_is_signaled(vm->last_unlocked))
+		return false;
+
+	vmbo = to_amdgpu_bo_vm(bo);
+	vmbo->pt_cache_fence = amdgpu_vm_pt_cache_fence(bo);
+	if (!vmbo->pt_cache_fence)
+		return false;
+
+	/* Drop the parent, a new one is set when the PT is reused */
+	amdgpu_bo_unref(&bo->parent);
+	/* oldest first, that is the first one to become idle */
+	list_add_tail(&vmbo->pt_cache, &vm->pt_cache);
+	vm->pt_cache_count++;
+
+	return true;
+}
+
+/**
+ * amdgpu_vm_pt_cache_fini - free all cached PTs
+ *
+ * @adev: amdgpu_device pointer
+ * @vm: VM to free the cache of
+ */
+static void amdgpu_vm_pt_cache_fini(struct amdgpu_device *adev,
+				    struct amdgpu_vm *vm)
+{
+	struct amdgpu_bo_vm *vmbo, *tmp;
+	struct amdgpu_bo *bo;
+
+	list_for_each_entry_safe(vmbo, tmp, &vm->pt_cache, pt_cache) {
+		list_del_init(&vmbo->pt_cache);
+		vm->pt_cache_count--;
+		dma_fence_put(vmbo->pt_cache_fence);
+		vmbo->pt_cache_fence = NULL;
+		atomic64_sub(amdgpu_vm_pt_bo_size(vmbo),
+			     &adev->vm_manager.pt_bytes);
+		atomic64_inc(&adev->vm_manager.pt_freed);
+		amdgpu_bo_unref(&vmbo->shadow);
+		bo = &vmbo->bo;
+		amdgpu_bo_unref(&bo);
+	}
+}
+
 /**
  * amdgpu_vm_pt_create - create bo for PD/PT
  *
@@ -491,7 +700,7 @@ int amdgpu_vm_pt_create(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 	bo = &(*vmbo)->bo;
 	if (vm->is_compute_context || (adev->flags & AMD_IS_APU)) {
 		(*vmbo)->shadow = NULL;
-		return 0;
+		goto out;
 	}
 
 	if (!bp.resv)
@@ -519,42 +728,52 @@ int amdgpu_vm_pt_create(struct amdgpu_device *adev, struct amdgpu_vm *vm,
 
 	amdgpu_bo_add_to_shadow_list(*vmbo);
 
+out:
+	atomic64_inc(&adev->vm_manager.pt_created);
+	atomic64_add(amdgpu_vm_pt_bo_size(*vmbo), &adev->vm_manager.pt_bytes);
 	return 0;
 }
 
 /**
  * amdgpu_vm_pt_alloc - Allocate a specific page table
  *
- * @adev: amdgpu_device pointer
- * @vm: VM to allocate page tables for
+ * @params: parameters for the update
  * @cursor: Which page table to allocate
- * @immediate: use an immediate update
  *
- * Make sure a specific page table or directory is allocated.
+ * Make sure a specific page table or directory is allocated. New tables are
+ * cleared as part of the update in @params instead of with their own job.
  *
  * Returns:
  * 1 if page table needed to be allocated, 0 if page table was already
  * allocated, negative errno if an error occurred.
  */
-static int amdgpu_vm_pt_alloc(struct amdgpu_device *adev,
-			      struct amdgpu_vm *vm,
-			      struct amdgpu_vm_pt_cursor *cursor,
-			      bool immediate)
+static int amdgpu_vm_pt_alloc(struct amdgpu_vm_update_params *params,
+			      struct amdgpu_vm_pt_cursor *cursor)
 {
 	struct amdgpu_vm_bo_base *entry = cursor->entry;
+	struct amdgpu_device *adev = params->adev;
+	struct amdgpu_vm *vm = params->vm;
+	struct amdgpu_bo_vm *pt = NULL;
 	struct amdgpu_bo *pt_bo;
-	struct amdgpu_bo_vm *pt;
 	int r;
 
 	if (entry->bo)
 		return 0;
 
-	amdgpu_vm_eviction_unlock(vm);
-	r = amdgpu_vm_pt_create(adev, vm, cursor->level, immediate, &pt,
-				vm->root.bo->xcp_id);
-	amdgpu_vm_eviction_lock(vm);
-	if (r)
-		return r;
+	if (cursor->level == AMDGPU_VM_PTB)
+		pt = amdgpu_vm_pt_cache_get(vm);
+
+	if (pt) {
+		atomic64_inc(&adev->vm_manager.pt_reused);
+	} else {
+		amdgpu_vm_eviction_unlock(vm);
+		r = amdgpu_vm_pt_create(adev, vm, cursor->level,
+					params->immediate, &pt,
+					vm->root.bo->xcp_id);
+		amdgpu_vm_eviction_lock(vm);
+		if (r)
+			return r;
+	}
 
 	/* Keep a reference to the root directory to avoid
 	 * freeing them up in the wrong order.
@@ -562,13 +781,20 @@ static int amdgpu_vm_pt_alloc(struct amdgpu_device *adev,
 	pt_bo = &pt->bo;
 	pt_bo->parent = amdgpu_bo_ref(cursor->parent->bo);
 	amdgpu_vm_bo_base_init(entry, vm, pt_bo);
-	r = amdgpu_vm_pt_clear(adev, vm, pt, immediate);
+
+	r = amdgpu_vm_pt_validate(pt);
+	if (r)
+		goto error_free_pt;
+
+	r = amdgpu_vm_pt_clear_entries(params, pt, cursor->level);
 	if (r)
 		goto error_free_pt;
 
 	return 0;
 
 error_free_pt:
+	atomic64_sub(amdgpu_vm_pt_bo_size(pt), &adev->vm_manager.pt_bytes);
+	atomic64_inc(&adev->vm_manager.pt_freed);
 	amdgpu_bo_unref(&pt->shadow);
 	amdgpu_bo_unref(&pt_bo);
 	return r;
@@ -581,22 +807,33 @@ error_free_pt:
  */
 static void amdgpu_vm_pt_free(struct amdgpu_vm_bo_base *entry)
 {
+	struct amdgpu_device *adev;
 	struct amdgpu_bo *shadow;
 
 	if (!entry->bo)
 		return;
 
+	adev = amdgpu_ttm_adev(entry->bo->tbo.bdev);
 	entry->bo->vm_bo = NULL;
 	shadow = amdgpu_bo_shadowed(entry->bo);
-	if (shadow) {
+	if (shadow)
 		ttm_bo_set_bulk_move(&shadow->tbo, NULL);
-		amdgpu_bo_unref(&shadow);
-	}
 	ttm_bo_set_bulk_move(&entry->bo->tbo, NULL);
 
 	spin_lock(&entry->vm->status_lock);
 	list_del(&entry->vm_status);
 	spin_unlock(&entry->vm->status_lock);
+
+	if (amdgpu_vm_pt_cache_put(adev, entry->vm, entry->bo)) {
+		entry->bo = NULL;
+		return;
+	}
+
+	atomic64_sub(amdgpu_vm_pt_bo_size(to_amdgpu_bo_vm(entry->bo)),
+		     &adev->vm_manager.pt_bytes);
+	atomic64_inc(&adev->vm_manager.pt_freed);
+	if (shadow)
+		amdgpu_bo_unref(&shadow);
 	amdgpu_bo_unref(&entry->bo);
 }
 
@@ -692,6 +929,8 @@ void amdgpu_vm_pt_free_root(struct amdgpu_device *adev, struct amdgpu_vm *vm)
 		if (entry)
 			amdgpu_vm_pt_free(entry);
 	}
+
+	amdgpu_vm_pt_cache_fini(adev, vm);
 }
 
 /**
@@ -895,8 +1134,7 @@ int amdgpu_vm_ptes_update(struct amdgpu_vm_update_params *params,
 			/* make sure that the page tables covering the
 			 * address range are actually allocated
 			 */
-			r = amdgpu_vm_pt_alloc(params->adev, params->vm,
-					       &cursor, params->immediate);
+			r = amdgpu_vm_pt_alloc(params, &cursor);
 			if (r)
 				return r;
 		}
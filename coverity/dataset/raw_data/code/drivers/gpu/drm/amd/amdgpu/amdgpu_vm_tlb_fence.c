@@ -32,7 +32,7 @@ struct amdgpu_tlb_fence {
 	struct dma_fence	base;
 	struct amdgpu_device	*adev;
 	struct dma_fence	*dependency;
-	struct work_struct	work;
+	struct list_head	node;
 	spinlock_t		lock;
 	uint16_t		pasid;
 
@@ -48,26 +48,59 @@ static const char *amdgpu_tlb_fence_get_timeline_name(struct dma_fence *f)
 	return "amdgpu tlb timeline";
 }
 
-static void amdgpu_tlb_fence_work(struct work_struct *work)
+/**
+ * amdgpu_vm_tlb_fence_work - coalesce pending TLB flushes of a VM
+ *
+ * @work: the per VM flush work
+ *
+ * Takes all TLB fences queued on the VM so far, waits for all of their page
+ * table updates and then invalidates the TLB once for the whole burst. The
+ * fences are signaled in creation order which keeps them ordered by tlb_seq.
+ */
+void amdgpu_vm_tlb_fence_work(struct work_struct *work)
 {
-	struct amdgpu_tlb_fence *f = container_of(work, typeof(*f), work);
-	int r;
-
-	if (f->dependency) {
-		dma_fence_wait(f->dependency, false);
-		dma_fence_put(f->dependency);
-		f->dependency = NULL;
+	struct amdgpu_vm *vm = container_of(work, typeof(*vm), tlb_flush_work);
+	struct amdgpu_tlb_fence *f, *tmp;
+	unsigned int num_fences = 0;
+	int pasid = -1;
+	LIST_HEAD(batch);
+	int r = 0;
+
+	spin_lock(&vm->tlb_flush_lock);
+	list_splice_init(&vm->tlb_flush_pending, &batch);
+	spin_unlock(&vm->tlb_flush_lock);
+
+	list_for_each_entry(f, &batch, node) {
+		if (f->dependency) {
+			dma_fence_wait(f->dependency, false);
+			dma_fence_put(f->dependency);
+			f->dependency = NULL;
+		}
+		++num_fences;
 	}
 
-	r = amdgpu_gmc_flush_gpu_tlb_pasid(f->adev, f->pasid, 2, true, 0);
-	if (r) {
-		dev_err(f->adev->dev, "TLB flush failed for PASID %d.\n",
-			f->pasid);
-		dma_fence_set_error(&f->base, r);
+	list_for_each_entry_safe(f, tmp, &batch, node) {
+		struct amdgpu_device *adev = f->adev;
+
+		/* The PASID only changes on VM init and fini */
+		if (f->pasid != pasid) {
+			pasid = f->pasid;
+			r = amdgpu_gmc_flush_gpu_tlb_pasid(adev, pasid, 2,
+							   true, 0);
+			if (r)
+				dev_err(adev->dev,
+					"TLB flush failed for PASID %d.\n",
+					pasid);
+			atomic64_inc(&adev->vm_manager.tlb_flush_issued);
+		}
+
+		if (r)
+			dma_fence_set_error(&f->base, r);
+
+		list_del(&f->node);
+		dma_fence_signal(&f->base);
+		dma_fence_put(&f->base);
 	}
-
-	dma_fence_signal(&f->base);
-	dma_fence_put(&f->base);
 }
 
 static const struct dma_fence_ops amdgpu_tlb_fence_ops = {
@@ -81,6 +114,8 @@ void amdgpu_vm_tlb_fence_create(struct amdgpu_device *adev, struct amdgpu_vm *vm
 {
 	struct amdgpu_tlb_fence *f;
 
+	atomic64_inc(&adev->vm_manager.tlb_flush_requested);
+
 	f = kmalloc(sizeof(*f), GFP_KERNEL);
 	if (!f) {
 		/*
@@ -91,6 +126,7 @@ void amdgpu_vm_tlb_fence_create(struct amdgpu_device *adev, struct amdgpu_vm *vm
 			dma_fence_wait(*fence, false);
 
 		amdgpu_gmc_flush_gpu_tlb_pasid(adev, vm->pasid, 2, true, 0);
+		atomic64_inc(&adev->vm_manager.tlb_flush_issued);
 		*fence = dma_fence_get_stub();
 		return;
 	}
@@ -98,15 +134,21 @@ void amdgpu_vm_tlb_fence_create(struct amdgpu_device *adev, struct amdgpu_vm *vm
 	f->adev = adev;
 	f->dependency = *fence;
 	f->pasid = vm->pasid;
-	INIT_WORK(&f->work, amdgpu_tlb_fence_work);
 	spin_lock_init(&f->lock);
 
 	dma_fence_init(&f->base, &amdgpu_tlb_fence_ops, &f->lock,
 		       vm->tlb_fence_context, atomic64_read(&vm->tlb_seq));
 
-	/* TODO: We probably need a separate wq here */
+	/*
+	 * Queue the fence on the VM, all fences which pile up while the
+	 * previous flush is still running are handled by a single flush.
+	 * TODO: We probably need a separate wq here
+	 */
 	dma_fence_get(&f->base);
-	schedule_work(&f->work);
+	spin_lock(&vm->tlb_flush_lock);
+	list_add_tail(&f->node, &vm->tlb_flush_pending);
+	spin_unlock(&vm->tlb_flush_lock);
+	schedule_work(&vm->tlb_flush_work);
 
 	*fence = &f->base;
 }
@@ -452,14 +452,12 @@ static int vpe_resume(void *handle)
 
 static void vpe_ring_insert_nop(struct amdgpu_ring *ring, uint32_t count)
 {
-	int i;
+	if (!count)
+		return;
 
-	for (i = 0; i < count; i++)
-		if (i == 0)
-			amdgpu_ring_write(ring, ring->funcs->nop |
-				VPE_CMD_NOP_HEADER_COUNT(count - 1));
-		else
-			amdgpu_ring_write(ring, ring->funcs->nop);
+	amdgpu_ring_write(ring, ring->funcs->nop |
+			  VPE_CMD_NOP_HEADER_COUNT(count - 1));
+	amdgpu_ring_write_fill(ring, ring->funcs->nop, count - 1);
 }
 
 static uint64_t vpe_get_csa_mc_addr(struct amdgpu_ring *ring, uint32_t vmid)
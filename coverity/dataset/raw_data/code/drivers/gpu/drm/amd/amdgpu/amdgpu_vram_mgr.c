@@ -453,7 +453,7 @@ static int amdgpu_vram_mgr_new(struct ttm_resource_manager *man,
 	struct amdgpu_vram_mgr *mgr = to_vram_mgr(man);
 	struct amdgpu_device *adev = to_amdgpu_device(mgr);
 	struct amdgpu_bo *bo = ttm_to_amdgpu_bo(tbo);
-	u64 vis_usage = 0, max_bytes, min_block_size;
+	u64 vis_usage = 0, max_bytes, min_block_size, huge_block = 0;
 	struct amdgpu_vram_mgr_resource *vres;
 	u64 size, remaining_size, lpfn, fpfn;
 	unsigned int adjust_dcc_size = 0;
@@ -483,6 +483,12 @@ static int amdgpu_vram_mgr_new(struct ttm_resource_manager *man,
 #endif
 		pages_per_block = max_t(u32, pages_per_block,
 					tbo->page_alignment);
+#ifdef CONFIG_ARCH_SUPPORTS_PUD_PFNMAP
+		/* Allow CPU mappings with PUD entries, see amdgpu_huge_mmap */
+		if (amdgpu_huge_mmap >= 2 &&
+		    bo->flags & AMDGPU_GEM_CREATE_CPU_ACCESS_REQUIRED)
+			huge_block = PUD_SIZE;
+#endif
 	}
 
 	vres = kzalloc(sizeof(*vres), GFP_KERNEL);
@@ -537,6 +543,9 @@ static int amdgpu_vram_mgr_new(struct ttm_resource_manager *man,
 
 		if (bo->flags & AMDGPU_GEM_CREATE_VRAM_CONTIGUOUS && adjust_dcc_size)
 			min_block_size = size;
+		else if (huge_block && size >= huge_block &&
+			 !(size & (huge_block - 1)))
+			min_block_size = huge_block;
 		else if ((size >= (u64)pages_per_block << PAGE_SHIFT) &&
 			 !(size & (((u64)pages_per_block << PAGE_SHIFT) - 1)))
 			min_block_size = (u64)pages_per_block << PAGE_SHIFT;
@@ -550,6 +559,11 @@ static int amdgpu_vram_mgr_new(struct ttm_resource_manager *man,
 					   &vres->blocks,
 					   vres->flags);
 
+		if (unlikely(r == -ENOSPC) && min_block_size == huge_block) {
+			huge_block = 0;
+			continue;
+		}
+
 		if (unlikely(r == -ENOSPC) && pages_per_block == ~0ul &&
 		    !(place->flags & TTM_PL_FLAG_CONTIGUOUS)) {
 			vres->flags &= ~DRM_BUDDY_CONTIGUOUS_ALLOCATION;
@@ -659,6 +673,27 @@ static void amdgpu_vram_mgr_del(struct ttm_resource_manager *man,
 	kfree(vres);
 }
 
+/*
+ * Advance @cursor over the next DMA segment, merging physically adjacent
+ * DRM_BUDDY blocks up to AMDGPU_MAX_SG_SEGMENT_SIZE. Returns the segment size
+ * and its VRAM offset in @start.
+ */
+static u64 amdgpu_vram_mgr_next_segment(struct amdgpu_res_cursor *cursor,
+					u64 *start)
+{
+	u64 size = 0, chunk;
+
+	*start = cursor->start;
+	while (cursor->remaining && cursor->start == *start + size &&
+	       size < AMDGPU_MAX_SG_SEGMENT_SIZE) {
+		chunk = min(cursor->size, AMDGPU_MAX_SG_SEGMENT_SIZE - size);
+		size += chunk;
+		amdgpu_res_next(cursor, chunk);
+	}
+
+	return size;
+}
+
 /**
  * amdgpu_vram_mgr_alloc_sgt - allocate and fill a sg table
  *
@@ -682,17 +717,18 @@ int amdgpu_vram_mgr_alloc_sgt(struct amdgpu_device *adev,
 	struct amdgpu_res_cursor cursor;
 	struct scatterlist *sg;
 	int num_entries = 0;
+	u64 start;
 	int i, r;
 
 	*sgt = kmalloc(sizeof(**sgt), GFP_KERNEL);
 	if (!*sgt)
 		return -ENOMEM;
 
-	/* Determine the number of DRM_BUDDY blocks to export */
+	/* Determine the number of contiguous segments to export */
 	amdgpu_res_first(res, offset, length, &cursor);
 	while (cursor.remaining) {
 		num_entries++;
-		amdgpu_res_next(&cursor, min(cursor.size, AMDGPU_MAX_SG_SEGMENT_SIZE));
+		amdgpu_vram_mgr_next_segment(&cursor, &start);
 	}
 
 	r = sg_alloc_table(*sgt, num_entries, GFP_KERNEL);
@@ -706,13 +742,13 @@ int amdgpu_vram_mgr_alloc_sgt(struct amdgpu_device *adev,
 	/*
 	 * Walk down DRM_BUDDY blocks to populate scatterlist nodes
 	 * @note: Use iterator api to get first the DRM_BUDDY block
-	 * and the number of bytes from it. Access the following
-	 * DRM_BUDDY block(s) if more buffer needs to exported
+	 * and the number of bytes from it. Physically adjacent
+	 * DRM_BUDDY blocks are merged into a single scatterlist node
 	 */
 	amdgpu_res_first(res, offset, length, &cursor);
 	for_each_sgtable_sg((*sgt), sg, i) {
-		phys_addr_t phys = cursor.start + adev->gmc.aper_base;
-		unsigned long size = min(cursor.size, AMDGPU_MAX_SG_SEGMENT_SIZE);
+		unsigned long size = amdgpu_vram_mgr_next_segment(&cursor, &start);
+		phys_addr_t phys = start + adev->gmc.aper_base;
 		dma_addr_t addr;
 
 		addr = dma_map_resource(dev, phys, size, dir,
@@ -724,8 +760,6 @@ int amdgpu_vram_mgr_alloc_sgt(struct amdgpu_device *adev,
 		sg_set_page(sg, NULL, size, 0);
 		sg_dma_address(sg) = addr;
 		sg_dma_len(sg) = size;
-
-		amdgpu_res_next(&cursor, size);
 	}
 
 	return 0;
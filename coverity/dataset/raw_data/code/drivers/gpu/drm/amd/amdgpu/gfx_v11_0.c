@@ -483,8 +483,6 @@ static void gfx_v11_0_wait_reg_mem(struct amdgpu_ring *ring, int eng_sel,
 
 static void gfx_v11_ring_insert_nop(struct amdgpu_ring *ring, uint32_t num_nop)
 {
-	int i;
-
 	/* Header itself is a NOP packet */
 	if (num_nop == 1) {
 		amdgpu_ring_write(ring, ring->funcs->nop);
@@ -495,8 +493,7 @@ static void gfx_v11_ring_insert_nop(struct amdgpu_ring *ring, uint32_t num_nop)
 	amdgpu_ring_write(ring, PACKET3(PACKET3_NOP, min(num_nop - 2, 0x3ffe)));
 
 	/* Header is at index 0, followed by num_nops - 1 NOP packet's */
-	for (i = 1; i < num_nop; i++)
-		amdgpu_ring_write(ring, ring->funcs->nop);
+	amdgpu_ring_write_fill(ring, ring->funcs->nop, num_nop - 1);
 }
 
 static int gfx_v11_0_ring_test_ring(struct amdgpu_ring *ring)
@@ -6714,7 +6711,9 @@ static void gfx_v11_ip_dump(void *handle)
 
 	amdgpu_gfx_off_ctrl(adev, false);
 	for (i = 0; i < reg_count; i++)
-		adev->gfx.ip_dump_core[i] = RREG32(SOC15_REG_ENTRY_OFFSET(gc_reg_list_11_0[i]));
+		adev->gfx.ip_dump_core[i] = SOC15_REG_ENTRY_OFFSET(gc_reg_list_11_0[i]);
+	amdgpu_device_rreg_batch(adev, adev->gfx.ip_dump_core,
+				 adev->gfx.ip_dump_core, reg_count);
 	amdgpu_gfx_off_ctrl(adev, true);
 
 	/* dump compute queue registers for all instances */
@@ -6729,11 +6728,13 @@ static void gfx_v11_ip_dump(void *handle)
 			for (k = 0; k < adev->gfx.mec.num_queue_per_pipe; k++) {
 				/* ME0 is for GFX so start from 1 for CP */
 				soc21_grbm_select(adev, adev->gfx.me.num_me + i, j, k, 0);
-				for (reg = 0; reg < reg_count; reg++) {
+				for (reg = 0; reg < reg_count; reg++)
 					adev->gfx.ip_dump_compute_queues[index + reg] =
-						RREG32(SOC15_REG_ENTRY_OFFSET(
-							gc_cp_reg_list_11[reg]));
-				}
+						SOC15_REG_ENTRY_OFFSET(gc_cp_reg_list_11[reg]);
+				amdgpu_device_rreg_batch(adev,
+							 &adev->gfx.ip_dump_compute_queues[index],
+							 &adev->gfx.ip_dump_compute_queues[index],
+							 reg_count);
 				index += reg_count;
 			}
 		}
@@ -6755,11 +6756,13 @@ static void gfx_v11_ip_dump(void *handle)
 			for (k = 0; k < adev->gfx.me.num_queue_per_pipe; k++) {
 				soc21_grbm_select(adev, i, j, k, 0);
 
-				for (reg = 0; reg < reg_count; reg++) {
+				for (reg = 0; reg < reg_count; reg++)
 					adev->gfx.ip_dump_gfx_queues[index + reg] =
-						RREG32(SOC15_REG_ENTRY_OFFSET(
-							gc_gfx_queue_reg_list_11[reg]));
-				}
+						SOC15_REG_ENTRY_OFFSET(gc_gfx_queue_reg_list_11[reg]);
+				amdgpu_device_rreg_batch(adev,
+							 &adev->gfx.ip_dump_gfx_queues[index],
+							 &adev->gfx.ip_dump_gfx_queues[index],
+							 reg_count);
 				index += reg_count;
 			}
 		}
@@ -5014,8 +5014,6 @@ static void gfx_v12_0_emit_mem_sync(struct amdgpu_ring *ring)
 
 static void gfx_v12_ring_insert_nop(struct amdgpu_ring *ring, uint32_t num_nop)
 {
-	int i;
-
 	/* Header itself is a NOP packet */
 	if (num_nop == 1) {
 		amdgpu_ring_write(ring, ring->funcs->nop);
@@ -5026,8 +5024,7 @@ static void gfx_v12_ring_insert_nop(struct amdgpu_ring *ring, uint32_t num_nop)
 	amdgpu_ring_write(ring, PACKET3(PACKET3_NOP, min(num_nop - 2, 0x3ffe)));
 
 	/* Header is at index 0, followed by num_nops - 1 NOP packet's */
-	for (i = 1; i < num_nop; i++)
-		amdgpu_ring_write(ring, ring->funcs->nop);
+	amdgpu_ring_write_fill(ring, ring->funcs->nop, num_nop - 1);
 }
 
 static void gfx_v12_ip_print(void *handle, struct drm_printer *p)
@@ -5105,7 +5102,9 @@ static void gfx_v12_ip_dump(void *handle)
 
 	amdgpu_gfx_off_ctrl(adev, false);
 	for (i = 0; i < reg_count; i++)
-		adev->gfx.ip_dump_core[i] = RREG32(SOC15_REG_ENTRY_OFFSET(gc_reg_list_12_0[i]));
+		adev->gfx.ip_dump_core[i] = SOC15_REG_ENTRY_OFFSET(gc_reg_list_12_0[i]);
+	amdgpu_device_rreg_batch(adev, adev->gfx.ip_dump_core,
+				 adev->gfx.ip_dump_core, reg_count);
 	amdgpu_gfx_off_ctrl(adev, true);
 
 	/* dump compute queue registers for all instances */
@@ -5120,11 +5119,13 @@ static void gfx_v12_ip_dump(void *handle)
 			for (k = 0; k < adev->gfx.mec.num_queue_per_pipe; k++) {
 				/* ME0 is for GFX so start from 1 for CP */
 				soc24_grbm_select(adev, adev->gfx.me.num_me + i, j, k, 0);
-				for (reg = 0; reg < reg_count; reg++) {
+				for (reg = 0; reg < reg_count; reg++)
 					adev->gfx.ip_dump_compute_queues[index + reg] =
-						RREG32(SOC15_REG_ENTRY_OFFSET(
-							gc_cp_reg_list_12[reg]));
-				}
+						SOC15_REG_ENTRY_OFFSET(gc_cp_reg_list_12[reg]);
+				amdgpu_device_rreg_batch(adev,
+							 &adev->gfx.ip_dump_compute_queues[index],
+							 &adev->gfx.ip_dump_compute_queues[index],
+							 reg_count);
 				index += reg_count;
 			}
 		}
@@ -5146,11 +5147,13 @@ static void gfx_v12_ip_dump(void *handle)
 			for (k = 0; k < adev->gfx.me.num_queue_per_pipe; k++) {
 				soc24_grbm_select(adev, i, j, k, 0);
 
-				for (reg = 0; reg < reg_count; reg++) {
+				for (reg = 0; reg < reg_count; reg++)
 					adev->gfx.ip_dump_gfx_queues[index + reg] =
-						RREG32(SOC15_REG_ENTRY_OFFSET(
-							gc_gfx_queue_reg_list_12[reg]));
-				}
+						SOC15_REG_ENTRY_OFFSET(gc_gfx_queue_reg_list_12[reg]);
+				amdgpu_device_rreg_batch(adev,
+							 &adev->gfx.ip_dump_gfx_queues[index],
+							 &adev->gfx.ip_dump_gfx_queues[index],
+							 reg_count);
 				index += reg_count;
 			}
 		}
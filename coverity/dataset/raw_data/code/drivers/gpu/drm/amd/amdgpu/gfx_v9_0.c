@@ -7167,8 +7167,6 @@ static void gfx_v9_0_emit_wave_limit(struct amdgpu_ring *ring, bool enable)
 
 static void gfx_v9_ring_insert_nop(struct amdgpu_ring *ring, uint32_t num_nop)
 {
-	int i;
-
 	/* Header itself is a NOP packet */
 	if (num_nop == 1) {
 		amdgpu_ring_write(ring, ring->funcs->nop);
@@ -7179,8 +7177,7 @@ static void gfx_v9_ring_insert_nop(struct amdgpu_ring *ring, uint32_t num_nop)
 	amdgpu_ring_write(ring, PACKET3(PACKET3_NOP, min(num_nop - 2, 0x3ffe)));
 
 	/* Header is at index 0, followed by num_nops - 1 NOP packet's */
-	for (i = 1; i < num_nop; i++)
-		amdgpu_ring_write(ring, ring->funcs->nop);
+	amdgpu_ring_write_fill(ring, ring->funcs->nop, num_nop - 1);
 }
 
 static int gfx_v9_0_reset_kgq(struct amdgpu_ring *ring, unsigned int vmid)
@@ -7367,7 +7364,9 @@ static void gfx_v9_ip_dump(void *handle)
 
 	amdgpu_gfx_off_ctrl(adev, false);
 	for (i = 0; i < reg_count; i++)
-		adev->gfx.ip_dump_core[i] = RREG32(SOC15_REG_ENTRY_OFFSET(gc_reg_list_9[i]));
+		adev->gfx.ip_dump_core[i] = SOC15_REG_ENTRY_OFFSET(gc_reg_list_9[i]);
+	amdgpu_device_rreg_batch(adev, adev->gfx.ip_dump_core,
+				 adev->gfx.ip_dump_core, reg_count);
 	amdgpu_gfx_off_ctrl(adev, true);
 
 	/* dump compute queue registers for all instances */
@@ -7383,11 +7382,13 @@ static void gfx_v9_ip_dump(void *handle)
 				/* ME0 is for GFX so start from 1 for CP */
 				soc15_grbm_select(adev, 1 + i, j, k, 0, 0);
 
-				for (reg = 0; reg < reg_count; reg++) {
+				for (reg = 0; reg < reg_count; reg++)
 					adev->gfx.ip_dump_compute_queues[index + reg] =
-						RREG32(SOC15_REG_ENTRY_OFFSET(
-							gc_cp_reg_list_9[reg]));
-				}
+						SOC15_REG_ENTRY_OFFSET(gc_cp_reg_list_9[reg]);
+				amdgpu_device_rreg_batch(adev,
+							 &adev->gfx.ip_dump_compute_queues[index],
+							 &adev->gfx.ip_dump_compute_queues[index],
+							 reg_count);
 				index += reg_count;
 			}
 		}
@@ -4563,8 +4563,6 @@ static void gfx_v9_4_3_enable_watchdog_timer(struct amdgpu_device *adev)
 
 static void gfx_v9_4_3_ring_insert_nop(struct amdgpu_ring *ring, uint32_t num_nop)
 {
-	int i;
-
 	/* Header itself is a NOP packet */
 	if (num_nop == 1) {
 		amdgpu_ring_write(ring, ring->funcs->nop);
@@ -4575,8 +4573,7 @@ static void gfx_v9_4_3_ring_insert_nop(struct amdgpu_ring *ring, uint32_t num_no
 	amdgpu_ring_write(ring, PACKET3(PACKET3_NOP, min(num_nop - 2, 0x3ffe)));
 
 	/* Header is at index 0, followed by num_nops - 1 NOP packet's */
-	for (i = 1; i < num_nop; i++)
-		amdgpu_ring_write(ring, ring->funcs->nop);
+	amdgpu_ring_write_fill(ring, ring->funcs->nop, num_nop - 1);
 }
 
 static void gfx_v9_4_3_ip_print(void *handle, struct drm_printer *p)
@@ -4657,8 +4654,12 @@ static void gfx_v9_4_3_ip_dump(void *handle)
 		xcc_offset = xcc_id * reg_count;
 		for (i = 0; i < reg_count; i++)
 			adev->gfx.ip_dump_core[xcc_offset + i] =
-				RREG32(SOC15_REG_ENTRY_OFFSET_INST(gc_reg_list_9_4_3[i],
-								   GET_INST(GC, xcc_id)));
+				SOC15_REG_ENTRY_OFFSET_INST(gc_reg_list_9_4_3[i],
+							    GET_INST(GC, xcc_id));
+		amdgpu_device_rreg_batch(adev,
+					 &adev->gfx.ip_dump_core[xcc_offset],
+					 &adev->gfx.ip_dump_core[xcc_offset],
+					 reg_count);
 	}
 	amdgpu_gfx_off_ctrl(adev, true);
 
@@ -4681,14 +4682,17 @@ static void gfx_v9_4_3_ip_dump(void *handle)
 					soc15_grbm_select(adev, 1 + i, j, k, 0,
 							  GET_INST(GC, xcc_id));
 
-					for (reg = 0; reg < reg_count; reg++) {
+					for (reg = 0; reg < reg_count; reg++)
 						adev->gfx.ip_dump_compute_queues
 							[xcc_offset +
 							 inst_offset + reg] =
-							RREG32(SOC15_REG_ENTRY_OFFSET_INST(
+							SOC15_REG_ENTRY_OFFSET_INST(
 								gc_cp_reg_list_9_4_3[reg],
-								GET_INST(GC, xcc_id)));
-					}
+								GET_INST(GC, xcc_id));
+					amdgpu_device_rreg_batch(adev,
+						&adev->gfx.ip_dump_compute_queues[xcc_offset + inst_offset],
+						&adev->gfx.ip_dump_compute_queues[xcc_offset + inst_offset],
+						reg_count);
 					inst_offset += reg_count;
 				}
 			}
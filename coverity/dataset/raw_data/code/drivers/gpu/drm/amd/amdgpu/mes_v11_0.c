@@ -168,6 +168,7 @@ static int mes_v11_0_submit_pkt_and_poll_completion(struct amdgpu_mes *mes,
 	union MESAPI__MISC *x_pkt = pkt;
 	const char *op_str, *misc_op_str;
 	unsigned long flags;
+	ktime_t submitted;
 	u64 status_gpu_addr;
 	u32 seq, status_offset;
 	u64 *status_ptr;
@@ -222,6 +223,7 @@ static int mes_v11_0_submit_pkt_and_poll_completion(struct amdgpu_mes *mes,
 				   sizeof(mes_status_pkt) / 4);
 
 	amdgpu_ring_commit(ring);
+	submitted = amdgpu_mes_api_submitted(mes);
 	spin_unlock_irqrestore(&mes->ring_lock[0], flags);
 
 	op_str = mes_v11_0_get_op_string(x_pkt);
@@ -236,7 +238,11 @@ static int mes_v11_0_submit_pkt_and_poll_completion(struct amdgpu_mes *mes,
 		dev_dbg(adev->dev, "MES msg=%d was emitted\n",
 			x_pkt->header.opcode);
 
-	r = amdgpu_fence_wait_polling(ring, seq, timeout);
+	if (amdgpu_mes_api_defer(mes, ring, seq, status_offset, timeout,
+				 submitted))
+		return 0;
+
+	r = amdgpu_mes_api_wait(mes, ring, seq, timeout, submitted);
 	if (r < 1 || !*status_ptr) {
 
 		if (misc_op_str)